@@ -12,24 +12,55 @@
 #include "alp_processor.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <new>
 
-// NOTE: All these macros all expect a local int variable called useLevel
+#include "diagnostics.h"
+#include "io_request_queue.h"
+#include "jit_compiler.h"
+#include "trace_buffer.h"
+
+// NOTE: All these macros all expect a local Registers* variable called regs,
+// typically this->current, i.e. the registers of the current level.
+//
+#define PREG regs->p
+#define AREG regs->a
+#define RREG regs->r
+#define SREG regs->s
+#define TREG regs->t
+#define CTRG getCTrigger (regs)
+#define VTRG getVTrigger (regs)
+#define KFLG regs->k
+
+#define SETP(value) regs->p = value
+#define SETA(value) regs->a = value
+#define SETR(value) regs->r = value
+#define SETS(value) regs->s = value
+#define SETT(value) regs->t = value
+
+#define SET_TRIGGERS(c, v) setTriggers (regs, c, v)
+
+#define DEFER_TRIGGERS(kind, a, b) {                                          \
+   regs->triggerKind = kind;                                                  \
+   regs->triggerA = a;                                                        \
+   regs->triggerB = b;                                                        \
+}
+
+// Relaxed atomic access, for data that may be accessed by more than one host
+// thread, i.e. when processors run on their own threads.
 //
-#define PREG this->preg [useLevel]
-#define AREG this->areg [useLevel]
-#define RREG this->rreg [useLevel]
-#define SREG this->sreg [useLevel]
-#define TREG this->treg [useLevel]
-#define CTRG this->cTrigger[useLevel]
-#define VTRG this->vTrigger[useLevel]
-#define KFLG this->kFlag[useLevel]
+template <typename Type>
+static inline Type loadRelaxed (const Type* p)
+{
+   return __atomic_load_n (p, __ATOMIC_RELAXED);
+}
 
-#define SETP(value) this->preg [useLevel] = value
-#define SETA(value) this->areg [useLevel] = value
-#define SETR(value) this->rreg [useLevel] = value
-#define SETS(value) this->sreg [useLevel] = value
-#define SETT(value) this->treg [useLevel] = value
+template <typename Type>
+static inline void storeRelaxed (Type* p, const Type value)
+{
+   __atomic_store_n (p, value, __ATOMIC_RELAXED);
+}
 
 // The primary ALP hardware mapped address range is =X7F00 to =X7FFF inclusive.
 // For a DataBus::Device we specify inclusive lower address and exclusive upper
@@ -45,6 +76,13 @@
 #define ADDR_LOW(n)  (0x7F00 - (n-1)*0x0100)
 #define ADDR_HIGH(n) (ADDR_LOW(n) + 0x00FF)    // must avoid the over flow
 
+// Use computed goto dispatch (GCC labels as values) when available.
+// Define L16E_NO_COMPUTED_GOTO to force the portable switch dispatch.
+//
+#if defined(__GNUC__) && !defined(L16E_NO_COMPUTED_GOTO)
+#define L16E_COMPUTED_GOTO
+#endif
+
 using namespace L16E;
 
 //------------------------------------------------------------------------------
@@ -69,7 +107,15 @@ ALP_Processor::ALP_Processor(const int slotIn,       // 1 for primary etc.
    slot (slotIn),
    alpKind (alpKindIn),
    numberLevels (alpKindIn == alp1 ? 4 : 2),
-   debug (false)
+   debug (false),
+   opcodeCounts (nullptr),
+   addressCounts (nullptr),
+   trace (nullptr),
+   engine (interpreter),
+   diagnostics (nullptr),
+   hasStopAddress (false),
+   stopAddress (0),
+   pendingEvent (completed)
 {
    if ((this->slot != 1) && (this->slot != 2)) {
       fprintf (stderr, "Bad slot: %d\n", slotIn);
@@ -77,27 +123,208 @@ ALP_Processor::ALP_Processor(const int slotIn,       // 1 for primary etc.
    }
 
    for (int useLevel = 0; useLevel < 4; useLevel++) {
-      this->preg [useLevel] = 0;
-      this->areg [useLevel] = 0;
-      this->rreg [useLevel] = 0;
-      this->sreg [useLevel] = 0;
-      this->treg [useLevel] = 0;
-
-      this->cTrigger [useLevel] = false;
-      this->vTrigger [useLevel] = false;
-      this->kFlag [useLevel] = false;
+      Registers* const regs = &this->registers [useLevel];
+      SETP(0);
+      SETA(0);
+      SETR(0);
+      SETS(0);
+      SETT(0);
+      SET_TRIGGERS(false, false);
+      KFLG = false;
+      regs->triggerA = 0;
+      regs->triggerB = 0;
    }
 
-   const unsigned int useLevel = 1;
-   this->level = useLevel;
+   this->setLevel (1);
    this->interruptRequested = false;
 
-   SETP(DataBus::addressFirst);    // =X8000
+   this->current->p = DataBus::addressFirst;    // =X8000
+
+   for (int page = 0; page < 16; page++) {
+      this->pageTable [page].read = nullptr;
+      this->pageTable [page].write = nullptr;
+      this->postedPageTable [page].read = nullptr;
+      this->postedPageTable [page].write = nullptr;
+   }
+
+   // Calling dispatch with no code just sets up the dispatch table.
+   //
+   int count;
+   this->dispatch (nullptr, 0, count);
+
+   this->decodeCache = new Decoded [numberCacheEntries];
+   this->invalidateCache (0, numberCacheEntries);
+
+   this->blockCache = new Block* [numberCacheEntries];
+   this->blockCoverage = new bool [numberCacheEntries];
+   for (int index = 0; index < numberCacheEntries; index++) {
+      this->blockCache [index] = nullptr;
+      this->blockCoverage [index] = false;
+   }
+   this->blocksStale = false;
+   this->jit = nullptr;
+
+   this->slowRead = false;
+   this->slowReadAddress = 0;
+   this->watchHitPending = false;
+   memset (&this->watchHit, 0, sizeof (this->watchHit));
+   this->busWrites = 0;
+   memset (&this->idleLoop, 0, sizeof (this->idleLoop));
+   this->idleLoop.fd = -1;
+   this->idleLoop.pollFd = -1;
+   this->fastForward = false;
+   this->ioQueue = nullptr;
+   this->mappingPosted = false;
+}
+
+//------------------------------------------------------------------------------
+//
+ALP_Processor::~ALP_Processor()
+{
+   this->flushBlocks ();
+   delete this->jit;
+   delete [] this->blockCoverage;
+   delete [] this->blockCache;
+   delete [] this->decodeCache;
+   delete [] this->opcodeCounts;
+   delete [] this->addressCounts;
+   delete this->trace;
+}
+
+//------------------------------------------------------------------------------
+//
+void ALP_Processor::setEngine (const Engines engineIn)
+{
+   this->engine = engineIn;
+
+   if (this->engine == nativeCompiler) {
+      if (!JIT_Compiler::isAvailable ()) {
+         printf ("%s: native compiler not available on this host, using block translator\n",
+                 this->getName());
+         this->engine = blockTranslator;
+      } else if (!this->jit) {
+         this->jit = new JIT_Compiler (this);
+      }
+   }
+}
+
+//------------------------------------------------------------------------------
+//
+ALP_Processor::Engines ALP_Processor::getEngine () const
+{
+   return this->engine;
+}
+
+//------------------------------------------------------------------------------
+//
+void ALP_Processor::setFastForward (const bool fastForwardIn)
+{
+   this->fastForward = fastForwardIn;
+   this->idleLoop.matches = 0;
+}
+
+//------------------------------------------------------------------------------
+//
+void ALP_Processor::setOpcodeCounting (const bool enable)
+{
+   if (enable) {
+      if (!this->opcodeCounts) this->opcodeCounts = new uint64_t [256];
+      memset (this->opcodeCounts, 0, 256 * sizeof (uint64_t));
+   } else {
+      delete [] this->opcodeCounts;
+      this->opcodeCounts = nullptr;
+   }
+}
+
+//------------------------------------------------------------------------------
+//
+const uint64_t* ALP_Processor::getOpcodeCounts () const
+{
+   return this->opcodeCounts;
+}
+
+//------------------------------------------------------------------------------
+//
+void ALP_Processor::setAddressCounting (const bool enable)
+{
+   if (enable) {
+      if (!this->addressCounts) this->addressCounts = new uint64_t [numberAddressCounts];
+      memset (this->addressCounts, 0, numberAddressCounts * sizeof (uint64_t));
+   } else {
+      delete [] this->addressCounts;
+      this->addressCounts = nullptr;
+   }
+}
+
+//------------------------------------------------------------------------------
+//
+const uint64_t* ALP_Processor::getAddressCounts () const
+{
+   return this->addressCounts;
+}
+
+//------------------------------------------------------------------------------
+//
+bool ALP_Processor::startTrace (const std::string filename, const int capacity)
+{
+   this->stopTrace ();
+
+   TraceBuffer* buffer = new TraceBuffer (filename, capacity);
+   if (!buffer->isOpen ()) {
+      delete buffer;
+      return false;
+   }
+   this->trace = buffer;
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+void ALP_Processor::stopTrace ()
+{
+   delete this->trace;
+   this->trace = nullptr;
+}
+
+//------------------------------------------------------------------------------
+//
+bool ALP_Processor::isTracing () const
+{
+   return this->trace != nullptr;
+}
+
+//------------------------------------------------------------------------------
+//
+bool ALP_Processor::getWatchHit (WatchHit& hit) const
+{
+   if (!this->watchHitPending) return false;
+   hit = this->watchHit;
+   return true;
+}
+
+//------------------------------------------------------------------------------
+// P has already been advanced past the instruction.
+//
+void ALP_Processor::noteWatchHit (const Int16 addr, const int kind,
+                                  const Int16 value) const
+{
+   if (this->watchHitPending) return;   // keep the first
+
+   this->watchHitPending = true;
+   this->watchHit.address = this->current->p - 2;
+   this->watchHit.location = addr;
+   this->watchHit.value = value;
+   this->watchHit.kind = kind;
+   this->watchHit.level = this->level;
+   this->pendingEvent = breakPoint;
 }
 
 //------------------------------------------------------------------------------
 //
-ALP_Processor::~ALP_Processor() { }
+void ALP_Processor::setDiagnostics (Diagnostics* diagnosticsIn)
+{
+   this->diagnostics = diagnosticsIn;
+}
 
 //------------------------------------------------------------------------------
 //
@@ -108,12 +335,76 @@ unsigned int ALP_Processor::getLevel() const
 
 //------------------------------------------------------------------------------
 //
-void ALP_Processor::dumpRegisters(const unsigned int useLevel) const
+inline void ALP_Processor::setLevel (const unsigned int levelIn)
+{
+   this->level = levelIn;
+   this->current = &this->registers [levelIn];
+}
+
+//------------------------------------------------------------------------------
+// static
+void* ALP_Processor::operator new (size_t size)
+{
+   void* result = nullptr;
+   if (posix_memalign (&result, alignof (Registers), size) != 0) {
+      throw std::bad_alloc ();
+   }
+   return result;
+}
+
+//------------------------------------------------------------------------------
+// static
+void ALP_Processor::operator delete (void* p)
+{
+   free (p);
+}
+
+//------------------------------------------------------------------------------
+// Triggers
+//------------------------------------------------------------------------------
+//
+inline bool ALP_Processor::getCTrigger (const Registers* regs)
+{
+   const int a = regs->triggerA;
+   switch (regs->triggerKind) {
+      case compareTriggers:    return a == regs->triggerB;
+      case arithmeticTriggers: return ((a >> 16) & 1) == 1;
+      default:                 return regs->c;
+   }
+}
+
+//------------------------------------------------------------------------------
+//
+inline bool ALP_Processor::getVTrigger (const Registers* regs)
+{
+   const int a = regs->triggerA;
+   switch (regs->triggerKind) {
+      case compareTriggers:    return a < regs->triggerB;
+      case arithmeticTriggers: return (a > 32767) || (a < -32768);
+      default:                 return regs->v;
+   }
+}
+
+//------------------------------------------------------------------------------
+//
+inline void ALP_Processor::setTriggers (Registers* regs,
+                                        const bool c, const bool v)
 {
-   // Many macros assume level variable is called "useLevel" exists".
+   regs->c = c;
+   regs->v = v;
+   regs->triggerKind = evaluatedTriggers;
+}
 
+//------------------------------------------------------------------------------
+//
+void ALP_Processor::dumpRegisters(const unsigned int useLevel) const
+{
    if (useLevel >= this->numberLevels) return;
 
+   // Many macros assume the variable called "regs" exists.
+   //
+   const Registers* const regs = &this->registers [useLevel];
+
    printf ("%d: Level %d: ", this->slot, useLevel);
 
    // Need to mask these values with 0xFFFF to make "positive" for printf.
@@ -139,8 +430,7 @@ void ALP_Processor::dumpRegisters () const
 //
 Int16  ALP_Processor::getPreg() const
 {
-   const unsigned int useLevel = this->level;
-   return PREG;
+   return this->current->p;
 }
 
 //------------------------------------------------------------------------------
@@ -154,9 +444,10 @@ Int16 ALP_Processor::getWord(const Int16 addr) const
    const unsigned int alpAddr = addr & 0x00FF;
    const unsigned int useLevel = alpAddr >> 4;
 
-   if (alpAddr == 0) return (this->interruptRequested << 4) | this->level;
+   if (alpAddr == 0) return (loadRelaxed (&this->interruptRequested) << 4) | this->level;
    if (useLevel >= this->numberLevels) return DataBus::allOnes;
 
+   const Registers* const regs = &this->registers [useLevel];
    const unsigned int reg = addr & 0x000F;
    switch (reg) {
       case 0x02: return PREG; break;
@@ -179,6 +470,7 @@ void ALP_Processor::setWord(const Int16 addr, const Int16 value)
 {
    const unsigned int useLevel = (addr >> 4) & 0x000F;
    if (useLevel >= this->numberLevels) return;
+   Registers* const regs = &this->registers [useLevel];
    const unsigned int reg = addr & 0x000F;
    switch (reg) {
       case 0x02: SETP(value); break;
@@ -187,8 +479,7 @@ void ALP_Processor::setWord(const Int16 addr, const Int16 value)
       case 0x08: SETS(value); break;
       case 0x0A: SETT(value); break;
       case 0x0C: {
-            CTRG = (value & 4) == 4;
-            VTRG = (value & 2) == 2;
+            SET_TRIGGERS ((value & 4) == 4, (value & 2) == 2);
             KFLG = (value & 1) == 1;
             break;
          }
@@ -200,998 +491,1458 @@ void ALP_Processor::setWord(const Int16 addr, const Int16 value)
 //
 void ALP_Processor::requestInterrupt()
 {
-   this->interruptRequested = true;
+   // When running on our own host thread, this is called from another thread
+   // and we just pick up the request before the next instruction.
+   //
+   storeRelaxed (&this->interruptRequested, true);
+   if (!this->ioQueue) this->pendingEvent = interrupt;
+}
+
+//------------------------------------------------------------------------------
+//
+void ALP_Processor::setIoRequestQueue (IoRequestQueue* queue)
+{
+   this->ioQueue = queue;
 }
 
 //------------------------------------------------------------------------------
 //
-bool ALP_Processor::execute()
+void ALP_Processor::saveState (std::vector<UInt8>& state) const
 {
-   // Sanity checks
-   //
-   if ((this->slot != 1) && (this->slot != 2)) {
-      printf ("Unexpected processor slot: %d\n", this->slot);
-      return false;
-   }
+   SavedState saved;
+   memset (&saved, 0, sizeof (saved));
 
-   if (this->level >= this->numberLevels) {
-      printf ("Unexpected process level: %u\n", this->level);
-      return false;
+   for (int useLevel = 0; useLevel < 4; useLevel++) {
+      const Registers* const regs = &this->registers [useLevel];
+      SavedLevel& level = saved.levels [useLevel];
+      level.p = PREG;
+      level.a = AREG;
+      level.r = RREG;
+      level.s = SREG;
+      level.t = TREG;
+      level.c = CTRG;
+      level.v = VTRG;
+      level.k = KFLG;
    }
+   saved.level = this->level;
+   saved.interruptRequested = loadRelaxed (&this->interruptRequested);
 
-   // First check for a pending interrupt request.
-   // Only level 0 can get interrupted - it was a design error.
-   // Note: we can't use KFLG until useLevel declared.
-   //
-   if (this->interruptRequested && (this->level == 0) && !this->kFlag[this->level]) {
-      // Switch to level 1.
-      //
-      this->level = 1;
-      this->interruptRequested = false;    // clear the request
-   }
+   const UInt8* p = reinterpret_cast <const UInt8*> (&saved);
+   state.assign (p, p + sizeof (saved));
+}
 
-   const int useLevel = this->level;       // Many macros assume useLevel exists.
-   const Int16 address = PREG;
-   const Int16 instruction = this->dataBus->getWord(address);   // Fetch
+//------------------------------------------------------------------------------
+//
+bool ALP_Processor::restoreState (const UInt8* state, const size_t size)
+{
+   SavedState saved;
+   if (size != sizeof (saved)) return false;
+   memcpy (&saved, state, sizeof (saved));
+   if (saved.level >= this->numberLevels) return false;
 
-   // Update P first-thing before executing the instruction proper.
+   for (int useLevel = 0; useLevel < 4; useLevel++) {
+      Registers* const regs = &this->registers [useLevel];
+      const SavedLevel& level = saved.levels [useLevel];
+      SETP(level.p);
+      SETA(level.a);
+      SETR(level.r);
+      SETS(level.s);
+      SETT(level.t);
+      SET_TRIGGERS(level.c, level.v);
+      KFLG = level.k;
+   }
+   this->setLevel (saved.level);
+   this->interruptRequested = saved.interruptRequested;
+   this->pendingEvent = completed;
+   memset (&this->idleLoop, 0, sizeof (this->idleLoop));
+   this->idleLoop.fd = -1;
+   this->idleLoop.pollFd = -1;
+
+   // Memory and the memory map have most likely changed as well, although
+   // they may not have been restored yet - the snapshot restore calls
+   // allMemoryModified once everything has been restored.
    //
-   SETP(address + 2);
-
-   const UInt8 msiByte = (instruction >> 8) & 255;
-   const UInt8 lsiByte = instruction & 255;
+   this->allMemoryModified ();
+   return true;
+}
 
-   // We calc a few things even if not all needed
-   // We will worry about efficiency later.
-   //
-   const bool isWord = (lsiByte & 1) == 0;           // as opposed to isByte
-   const bool isIndirect = (lsiByte & 1) == 1;       // as opposed to direct
-   const Int16 sign = (msiByte & 1) == 0 ? +1 : -1;  // offset sign
-   const Int16 wordOffset = sign * lsiByte;
-   const Int16 byteOffset = sign * (lsiByte >> 1);
-   const Int16 jumpOffset = sign * (lsiByte & 0xFE);
-
-   #define WOFFSET   lsInstructionByte
-   #define BOFFSET  (lsInstructionByte >> 1)
-   #define IOFFSET  (lsInstructionByte & 0xFE)
-
-   // Macro funtions
+//------------------------------------------------------------------------------
+// Predecoded instruction cache.
+//------------------------------------------------------------------------------
+//
+bool ALP_Processor::initialise ()
+{
+   // Memory and ROM are initialised before we get to execute anything,
+   // but just in case, start with a clean slate.
    //
-   #define UNDEFINED {                                                        \
-      printf ("Undefined instruction: (%04X) %04X\n",                         \
-              address & 0xFFFF, instruction & 0xFFFF);                        \
-      return false;                                                           \
-   }
-
+   this->invalidateCache (0, numberCacheEntries);
+   this->flushBlocks ();
+   this->mappingModified ();
+   this->applyMapping ();
+   return true;
+}
 
-   #define STRX_Y(x,y)  {                                                     \
-      if (isWord) {                                                           \
-         this->dataBus->setWord (y##REG + wordOffset, x##REG);                \
-      } else {                                                                \
-         this->dataBus->setByte (y##REG + byteOffset, x##REG);                \
-      }                                                                       \
-   }
+//------------------------------------------------------------------------------
+// Only called when not running.
+//
+void ALP_Processor::allMemoryModified ()
+{
+   this->invalidateCache (0, numberCacheEntries);
+   this->flushBlocks ();
+   this->mappingModified ();
+   this->applyMapping ();
+}
 
+//------------------------------------------------------------------------------
+// Blocks end before each break point, so must be retranslated.
+//
+void ALP_Processor::breakPointsModified ()
+{
+   storeRelaxed (&this->blocksStale, true);
+}
 
-   // Basic operations
-   // Trigger association is kind of speculitive.
+//------------------------------------------------------------------------------
+//
+void ALP_Processor::memoryModified (const Int16 addr)
+{
+   // We may be called by another processor's host thread.
    //
-   #define SETX(x, regvalue) {                                                \
-      SET##x(regvalue);                                                       \
-      const int r = x##REG;                                                   \
-      CTRG = (r == 0);                                                        \
-      VTRG = (r <  0);                                                        \
-   }
-
-
-   #define ADDX(x, operand) {                                                 \
-      const int t = x##REG + (operand);                                       \
-      SET##x(t);                                                              \
-      CTRG = ((t >> 16) & 1) == 1;                                            \
-      VTRG = (t > 32767) || (t < -32768);                                     \
-   }
+   storeRelaxed (&this->busWrites, loadRelaxed (&this->busWrites) + 1);
 
+   const int index = (addr >> 1) & 0x7FFF;
+   this->invalidateEntry (index);
 
-   #define SUBX(x, operand) {                                                 \
-      const int t = x##REG - (operand);                                       \
-      SET##x(t);                                                              \
-      CTRG = ((t >> 16) & 1) == 1;                                            \
-      VTRG = (t > 32767) || (t < -32768);                                     \
+   // Another processor's mappable memory block may be mapped to a different
+   // address range (=X2000 .. =X5FFF) by our own map register. The offset
+   // within the block is the same, so we invalidate that offset in each of
+   // the four mappable ranges. The fixed ranges are never aliased.
+   //
+   const int msAddrNib = (addr >> 12) & 15;
+   if ((msAddrNib >= 2) && (msAddrNib <= 5)) {
+      const int wordOffset = index & 0x07FF;
+      for (int j = 2; j <= 5; j++) {
+         this->invalidateEntry ((j << 11) | wordOffset);
+      }
    }
+}
 
-
-   // TODO: verify which JxC/JxN corresponds to == and <
+//------------------------------------------------------------------------------
+//
+inline void ALP_Processor::invalidateEntry (const int index)
+{
+   // Release, so that the memory modification is visible to a thread that
+   // sees this store, see decodeEntry.
    //
-   #define CMPX(x, operand) {                                                 \
-      const int r = x##REG;                                                   \
-      const int v = operand;                                                  \
-      CTRG = (r == v);                                                        \
-      VTRG = (r <  v);                                                        \
+   __atomic_store_n (&this->decodeCache [index].isValid, false, __ATOMIC_RELEASE);
+   if (loadRelaxed (&this->blockCoverage [index])) {
+      storeRelaxed (&this->blocksStale, true);
    }
+}
 
+//------------------------------------------------------------------------------
+//
+// We may be called by another thread while this processor runs on its own
+// thread, e.g. by the main thread servicing another processor's write to our
+// map register. So the new page table is built here, where the mapping is
+// stable, and posted for this processor's thread to apply, together with the
+// cache invalidations, before its next instruction or block.
+//
+void ALP_Processor::mappingModified ()
+{
+   std::lock_guard <std::mutex> guard (this->mappingLock);
+   this->buildPageTable (this->postedPageTable);
+   __atomic_store_n (&this->mappingPosted, true, __ATOMIC_RELEASE);
+}
 
-   #define ANDX(x, operand)  SET##x(x##REG & (operand))
-
-   #define IORX(x, operand)  SET##x(x##REG | (operand))
-
-   #define NEQX(x, operand)  SET##x(x##REG ^ (operand))
+//------------------------------------------------------------------------------
+//
+void ALP_Processor::applyMapping ()
+{
+   {
+      std::lock_guard <std::mutex> guard (this->mappingLock);
+      memcpy (this->pageTable, this->postedPageTable, sizeof (this->pageTable));
+      storeRelaxed (&this->mappingPosted, false);
+   }
 
+   // Only =X2000 to =X5FFF is mappable.
+   //
+   this->invalidateCache (DataBus::X2000 >> 1, DataBus::X6000 >> 1);
+   if (!this->blockStarts.empty()) storeRelaxed (&this->blocksStale, true);
+}
 
-   #define ACCESS(y) (isWord ? this->dataBus->getWord(y##REG + wordOffset)    \
-                             : this->dataBus->getByte(y##REG + byteOffset))
+//------------------------------------------------------------------------------
+//
+void ALP_Processor::invalidateCache (const int first, const int last)
+{
+   for (int index = first; index < last; index++) {
+      storeRelaxed (&this->decodeCache [index].isValid, false);
+   }
+}
 
+//------------------------------------------------------------------------------
+// Page table
+//------------------------------------------------------------------------------
+//
+void ALP_Processor::buildPageTable (Page table [16]) const
+{
+   for (int page = 0; page < 16; page++) {
+      const Int16 addr = page << 12;
+      table [page].read =
+            this->dataBus->getHostPage (addr, this->activeIdentity, false);
+      table [page].write =
+            this->dataBus->getHostPage (addr, this->activeIdentity, true);
+   }
+}
 
-   #define SETX_Y(x,y)  SETX(x, ACCESS(y))
-   #define SETT_Y(  y)  SETT(   ACCESS(y))
-   #define ADDX_Y(x,y)  ADDX(x, ACCESS(y))
-   #define SUBX_Y(x,y)  SUBX(x, ACCESS(y))
-   #define CMPX_Y(x,y)  CMPX(x, ACCESS(y))
-   #define ANDX_Y(x,y)  ANDX(x, ACCESS(y))
-   #define IORX_Y(x,y)  IORX(x, ACCESS(y))
-   #define NEQX_Y(x,y)  NEQX(x, ACCESS(y))
+//------------------------------------------------------------------------------
+// Memory is big endian, and a word access ignores the address ls bit.
+//
+// Host memory may be shared with other processors running on their own host
+// threads, hence the (relaxed) atomic accesses - these are just plain loads
+// and stores on x86.
+//
+template <>
+inline Int16 ALP_Processor::readMemory <true> (const Int16 addr) const
+{
+   const UInt8* page = this->pageTable [(addr >> 12) & 15].read;
+   if (!page) {
+      if (this->dataBus->isTrapped (addr)) return this->trappedRead <true> (addr);
+      this->slowRead = true;
+      this->slowReadAddress = addr;
+      return this->busGetWord (addr);
+   }
+   return __builtin_bswap16 (loadRelaxed (reinterpret_cast <const Int16*> (&page [addr & 0x0FFE])));
+}
 
+//------------------------------------------------------------------------------
+//
+template <>
+inline Int16 ALP_Processor::readMemory <false> (const Int16 addr) const
+{
+   const UInt8* page = this->pageTable [(addr >> 12) & 15].read;
+   if (!page) {
+      if (this->dataBus->isTrapped (addr)) return this->trappedRead <false> (addr);
+      this->slowRead = true;
+      this->slowReadAddress = addr;
+      return this->busGetByte (addr);
+   }
+   return loadRelaxed (&page [addr & 0x0FFF]);
+}
 
-   #define MLTA_Y(y) {                                                        \
-      long t = AREG * ACCESS(y) * 2;                                          \
-      SETA(t >> 16);                                                          \
-      SETR(t);                                                                \
+//------------------------------------------------------------------------------
+// Memory modifications must still be notified to all active devices.
+//
+template <>
+inline void ALP_Processor::writeMemory <true> (const Int16 addr, const Int16 value)
+{
+   UInt8* page = this->pageTable [(addr >> 12) & 15].write;
+   if (!page) {
+      this->busSetWord (addr, value);
+      if (this->dataBus->isTrapped (addr) &&
+          this->dataBus->isWatched (addr, DataBus::watchWrite))
+      {
+         this->noteWatchHit (addr, DataBus::watchWrite, value);
+      }
+      return;
    }
+   storeRelaxed (reinterpret_cast <Int16*> (&page [addr & 0x0FFE]), Int16 (__builtin_bswap16 (value)));
+   this->dataBus->memoryModified (addr);
+}
 
+//------------------------------------------------------------------------------
+//
+template <>
+inline void ALP_Processor::writeMemory <false> (const Int16 addr, const Int16 value)
+{
+   UInt8* page = this->pageTable [(addr >> 12) & 15].write;
+   if (!page) {
+      this->busSetByte (addr, value);
+      if (this->dataBus->isTrapped (addr) &&
+          this->dataBus->isWatched (addr, DataBus::watchWrite))
+      {
+         this->noteWatchHit (addr, DataBus::watchWrite, value & 0xFF);
+      }
+      return;
+   }
+   storeRelaxed (&page [addr & 0x0FFF], UInt8 (value));
+   this->dataBus->memoryModified (addr);
+}
 
-   // General Jump macro
-   //
-   #define JUMP(condition, index) {                                           \
-      if (condition) {                                                        \
-         if (isIndirect) {                                                    \
-            SETP(this->dataBus->getWord(index##REG + jumpOffset));            \
-         } else {                                                             \
-            SETP(index##REG + jumpOffset);                                    \
-         }                                                                    \
-      }                                                                       \
+//------------------------------------------------------------------------------
+// A read from a page trapped for watch points. This is memory, not a device
+// register, so not a candidate idle poll.
+//
+template <bool isWord>
+Int16 ALP_Processor::trappedRead (const Int16 addr) const
+{
+   const Int16 value = isWord ? this->busGetWord (addr) : this->busGetByte (addr);
+   if (this->dataBus->isWatched (addr, DataBus::watchRead)) {
+      this->noteWatchHit (addr, DataBus::watchRead, value);
    }
+   return value;
+}
 
+//------------------------------------------------------------------------------
+// Instruction fetch for decoding - not an operand read.
+//
+inline Int16 ALP_Processor::fetchWord (const Int16 addr) const
+{
+   const UInt8* page = this->pageTable [(addr >> 12) & 15].read;
+   if (!page) return this->busGetWord (addr);
+   return __builtin_bswap16 (loadRelaxed (reinterpret_cast <const Int16*> (&page [addr & 0x0FFE])));
+}
 
-   // These are not independent instructions.
-   // #define JEZX(x)      JUMP(x##REG == 0, P)
-   // #define JNZX(x)      JUMP(x##REG != 0, P)
-   // #define JPZX(x)      JUMP(x##REG >= 0, P)
-   // #define JNGX(x)      JUMP(x##REG <  0, P)
+//------------------------------------------------------------------------------
+// The data bus slow path. When running on our own host thread, the request is
+// serialised with all other data bus accesses via our I/O request queue.
+//
+Int16 ALP_Processor::busGetWord (const Int16 addr) const
+{
+   if (this->ioQueue) return this->ioQueue->getWord (addr);
+   return this->dataBus->getWord (addr);
+}
 
+//------------------------------------------------------------------------------
+//
+UInt8 ALP_Processor::busGetByte (const Int16 addr) const
+{
+   if (this->ioQueue) return this->ioQueue->getByte (addr);
+   return this->dataBus->getByte (addr);
+}
 
-   if (this->debug) {
-      printf ("%+1d   B:%d   I:%d\n", sign, !isWord, isIndirect);
-      printf ("%+3d   %+3d   %+3d \n", wordOffset, byteOffset, jumpOffset);
+//------------------------------------------------------------------------------
+//
+void ALP_Processor::busSetWord (const Int16 addr, const Int16 value)
+{
+   if (this->ioQueue) {
+      this->ioQueue->setWord (addr, value);
+   } else {
+      this->dataBus->setWord (addr, value);
    }
+}
+
+//------------------------------------------------------------------------------
+//
+void ALP_Processor::busSetByte (const Int16 addr, const UInt8 value)
+{
+   if (this->ioQueue) {
+      this->ioQueue->setByte (addr, value);
+   } else {
+      this->dataBus->setByte (addr, value);
+   }
+}
+
+//------------------------------------------------------------------------------
+//
+bool ALP_Processor::busIsIdlePoll (const Int16 addr, int& fd) const
+{
+   if (this->ioQueue) return this->ioQueue->isIdlePoll (addr, fd);
+   return this->dataBus->isIdlePoll (addr, fd);
+}
+
+//------------------------------------------------------------------------------
+// Offset sign, indexed by the least significant bit of the msi byte.
+//
+static constexpr int offsetSign [2] = { +1, -1 };
+
+//------------------------------------------------------------------------------
+// Do all the decoding we can do once, as opposed to every time the
+// instruction is executed.
+//
+void ALP_Processor::decode (const Int16 instruction, Decoded& decoded) const
+{
+   const UInt8 msiByte = (instruction >> 8) & 255;
+   const UInt8 lsiByte = instruction & 255;
+   const int byteFlag = lsiByte & 1;                 // for memory references
+   const bool isJump = (msiByte >= 0xC0) && (msiByte <= 0xD7);
 
-   // Decode/execute the instruction
+   decoded.instruction = instruction;
+   decoded.lsiByte = lsiByte;
+   decoded.isWord = (byteFlag == 0);
+
+   // Word offsets are the lsi byte as is, byte offsets are halved; and jump
+   // offsets are always words, the byte flag meaning indirect.
    //
-   switch (msiByte) {
+   const int magnitude = isJump ? (lsiByte & 0xFE) : (lsiByte >> byteFlag);
+   decoded.offset = offsetSign [msiByte & 1] * magnitude;
 
-      // SET i.e. LOAD
-      //
-      case 0x00:
-      case 0x01:
-         SETX_Y(A, P);
-         break;
-
-      case 0x02:
-      case 0x03:
-         SETX_Y(A, R);
-         break;
-
-      case 0x04:
-      case 0x05:
-         SETX_Y(A, S);
-         break;
-
-      case 0x06:
-      case 0x07:
-         SETX_Y(A, T);
-         break;
-
-      case 0x08:
-      case 0x09:
-         SETX_Y(R, P);
-         break;
-
-      case 0x0A:
-      case 0x0B:
-         SETX_Y(R, R);
-         break;
-
-      case 0x0C:
-      case 0x0D:
-         SETX_Y(R, S);
-         break;
-
-      case 0x0E:
-      case 0x0F:
-         SETX_Y(R, T);
-         break;
-
-      case 0x10:
-      case 0x11:
-         SETX_Y(S, P);
-         break;
-
-      case 0x12:
-      case 0x13:
-         SETX_Y(S, R);
-         break;
-
-      case 0x14:
-      case 0x15:
-         SETX_Y(S, S);
-         break;
-
-      case 0x16:
-      case 0x17:
-         SETX_Y(S, T);
-         break;
-
-      case 0x18:
-      case 0x19:
-         SETT_Y(P);
-         break;
-
-      case 0x1A:
-      case 0x1B:
-         SETT_Y(R);
-         break;
-
-      case 0x1C:
-      case 0x1D:
-         SETT_Y(S);
-         break;
-
-      case 0x1E:
-      case 0x1F:
-         SETT_Y(T);
-         break;
-
-      // STR
-      //
-      case 0x20:
-      case 0x21:
-         STRX_Y(A, P);
-         break;
-
-      case 0x22:
-      case 0x23:
-         STRX_Y(A, R);
-         break;
-
-      case 0x24:
-      case 0x25:
-         STRX_Y(A, S);
-         break;
-
-      case 0x26:
-      case 0x27:
-         STRX_Y(A, T);
-         break;
-
-      case 0x28:
-      case 0x29:
-         STRX_Y(R, P);
-         break;
-
-      case 0x2A:
-      case 0x2B:
-         STRX_Y(R, R);
-         break;
-
-      case 0x2C:
-      case 0x2D:
-         STRX_Y(R, S);
-         break;
-
-      case 0x2E:
-      case 0x2F:
-         STRX_Y(R, T);
-         break;
-
-      case 0x30:
-      case 0x31:
-         STRX_Y(S, P);
-         break;
-
-      case 0x32:
-      case 0x33:
-         STRX_Y(S, R);
-         break;
-
-      case 0x34:
-      case 0x35:
-         STRX_Y(S, S);
-         break;
-
-      case 0x36:
-      case 0x37:
-         STRX_Y(S, T);
-         break;
-
-      case 0x38:
-      case 0x39:
-         STRX_Y(T, P);
-         break;
-
-      case 0x3A:
-      case 0x3B:
-         STRX_Y(T, R);
-         break;
-
-      case 0x3C:
-      case 0x3D:
-         STRX_Y(T, S);
-         break;
-
-      case 0x3E:
-      case 0x3F:
-         STRX_Y(T, T);
-         break;
-
-
-      // ADD
-      //
-      case 0x40:
-      case 0x41:
-         ADDX_Y(A, P);
-         break;
-
-      case 0x42:
-      case 0x43:
-         ADDX_Y(A, R);
-         break;
-
-      case 0x44:
-      case 0x45:
-         ADDX_Y(A, S);
-         break;
-
-      case 0x46:
-      case 0x47:
-         ADDX_Y(A, T);
-         break;
-
-      case 0x48:
-      case 0x49:
-         ADDX_Y(R, P);
-         break;
-
-      case 0x4A:
-      case 0x4B:
-         ADDX_Y(R, R);
-         break;
-
-      case 0x4C:
-      case 0x4D:
-         ADDX_Y(R, S);
-         break;
-
-      case 0x4E:
-      case 0x4F:
-         ADDX_Y(R, T);
-         break;
-
-      case 0x50:
-      case 0x51:
-         ADDX_Y(S, P);
-         break;
-
-      case 0x52:
-      case 0x53:
-         ADDX_Y(S, R);
-         break;
-
-      case 0x54:
-      case 0x55:
-         ADDX_Y(S, S);
-         break;
-
-      case 0x56:
-      case 0x57:
-         ADDX_Y(S, T);
-         break;
-
-      case 0x58:
-      case 0x59:
-         ADDX_Y(T, P);
-         break;
-
-      case 0x5A:
-      case 0x5B:
-         ADDX_Y(T, R);
-         break;
-
-      case 0x5C:
-      case 0x5D:
-         ADDX_Y(T, S);
-         break;
-
-      case 0x5E:
-      case 0x5F:
-         ADDX_Y(T, T);
-         break;
-
-      // CMP
-      //
-      case 0x60:
-      case 0x61:
-         CMPX_Y(A, P);
-         break;
-
-      case 0x62:
-      case 0x63:
-         CMPX_Y(A, R);
-         break;
-
-      case 0x64:
-      case 0x65:
-         CMPX_Y(A, S);
-         break;
-
-      case 0x66:
-      case 0x67:
-         CMPX_Y(A, T);
-         break;
-
-      case 0x68:
-      case 0x69:
-         CMPX_Y(R, P);
-         break;
-
-      case 0x6A:
-      case 0x6B:
-         CMPX_Y(R, R);
-         break;
-
-      case 0x6C:
-      case 0x6D:
-         CMPX_Y(R, S);
-         break;
-
-      case 0x6E:
-      case 0x6F:
-         CMPX_Y(R, T);
-         break;
-
-      case 0x70:
-      case 0x71:
-         CMPX_Y(S, P);
-         break;
-
-      case 0x72:
-      case 0x73:
-         CMPX_Y(S, R);
-         break;
-
-      case 0x74:
-      case 0x75:
-         CMPX_Y(S, S);
-         break;
-
-      case 0x76:
-      case 0x77:
-         CMPX_Y(S, T);
-         break;
-
-      case 0x78:
-      case 0x79:
-         CMPX_Y(T, P);
-         break;
-
-      case 0x7A:
-      case 0x7B:
-         CMPX_Y(T, R);
-         break;
-
-      case 0x7C:
-      case 0x7D:
-         CMPX_Y(T, S);
-         break;
-
-      case 0x7E:
-      case 0x7F:
-         CMPX_Y(T, T);
-         break;
-
-      // SUB
-      //
-      case 0x80:
-      case 0x81:
-         SUBX_Y(A, P);
-         break;
-
-      case 0x82:
-      case 0x83:
-         SUBX_Y(A, R);
-         break;
-
-      case 0x84:
-      case 0x85:
-         SUBX_Y(A, S);
-         break;
-
-      case 0x86:
-      case 0x87:
-         SUBX_Y(A, T);
-         break;
-
-      case 0x88:
-      case 0x89:
-         SUBX_Y(R, P);
-         break;
-
-      case 0x8A:
-      case 0x8B:
-         SUBX_Y(R, R);
-         break;
-
-      case 0x8C:
-      case 0x8D:
-         SUBX_Y(R, S);
-         break;
-
-      case 0x8E:
-      case 0x8F:
-         SUBX_Y(R, T);
-         break;
-
-      // AND/MASK
-      //
-      case 0x90:
-      case 0x91:
-         ANDX_Y(A, P);
-         break;
-
-      case 0x92:
-      case 0x93:
-         ANDX_Y(A, R);
-         break;
-
-      case 0x94:
-      case 0x95:
-         ANDX_Y(A, S);
-         break;
-
-      case 0x96:
-      case 0x97:
-         ANDX_Y(A, T);
-         break;
-
-      case 0x98:
-      case 0x99:
-         ANDX_Y(R, P);
-         break;
-
-      case 0x9A:
-      case 0x9B:
-         ANDX_Y(R, R);
-         break;
-
-      case 0x9C:
-      case 0x9D:
-         ANDX_Y(R, S);
-         break;
-
-      case 0x9E:
-      case 0x9F:
-         ANDX_Y(R, T);
-         break;
-
-
-      // NEQ/XOR
-      //
-      case 0xA0:
-      case 0xA1:
-         NEQX_Y(A, P);
-         break;
-
-      case 0xA2:
-      case 0xA3:
-         NEQX_Y(A, R);
-         break;
-
-      case 0xA4:
-      case 0xA5:
-         NEQX_Y(A, S);
-         break;
-
-      case 0xA6:
-      case 0xA7:
-         NEQX_Y(A, T);
-         break;
-
-      case 0xA8:
-      case 0xA9:
-         NEQX_Y(R, P);
-         break;
-
-      case 0xAA:
-      case 0xAB:
-         NEQX_Y(R, R);
-         break;
-
-      case 0xAC:
-      case 0xAD:
-         NEQX_Y(R, S);
-         break;
-
-      case 0xAE:
-      case 0xAF:
-         NEQX_Y(R, T);
-         break;
-
-
-      // IOR
-      //
-      case 0xB0:
-      case 0xB1:
-         IORX_Y(A, P);
-         break;
-
-      case 0xB2:
-      case 0xB3:
-         IORX_Y(A, R);
-         break;
-
-      case 0xB4:
-      case 0xB5:
-         IORX_Y(A, S);
-         break;
-
-      case 0xB6:
-      case 0xB7:
-         IORX_Y(A, T);
-         break;
-
-      case 0xB8:
-      case 0xB9:
-         IORX_Y(R, P);
-         break;
-
-      case 0xBA:
-      case 0xBB:
-         IORX_Y(R, R);
-         break;
-
-      case 0xBC:
-      case 0xBD:
-         IORX_Y(R, S);
-         break;
-
-      case 0xBE:
-      case 0xBF:
-         IORX_Y(R, T);
-         break;
-
-
-      // J
+   const int key = (msiByte << 1) | byteFlag;
+   decoded.handler = ALP_Processor::handlerMap [key];
+   decoded.target = ALP_Processor::dispatchTable ?
+                    ALP_Processor::dispatchTable [key] : nullptr;
+}
+
+//------------------------------------------------------------------------------
+// Decodes the instruction at address into its decode cache entry, and marks
+// it valid. When processors run on their own threads, another thread may
+// modify the instruction, and invalidate the entry, while we decode it - we
+// must not then mark the entry valid after the invalidation. So the entry
+// is marked valid by an exchange, which synchronises with any invalidation
+// that precedes it, and then the instruction is fetched again. If it has not
+// changed, any later modification will invalidate the entry; otherwise we
+// decode again. Only this processor's thread writes the other entry fields.
+//
+void ALP_Processor::decodeEntry (const Int16 address, Decoded& decoded) const
+{
+   Int16 instruction = this->fetchWord (address);
+   while (true) {
+      this->decode (instruction, decoded);
+      (void) __atomic_exchange_n (&decoded.isValid, true, __ATOMIC_ACQ_REL);
+
+      const Int16 check = this->fetchWord (address);
+      if (check == instruction) break;
+
+      storeRelaxed (&decoded.isValid, false);
+      instruction = check;
+   }
+}
+
+//------------------------------------------------------------------------------
+//
+bool ALP_Processor::prepareToExecute()
+{
+   // Sanity checks
+   //
+   if ((this->slot != 1) && (this->slot != 2)) {
+      printf ("Unexpected processor slot: %d\n", this->slot);
+      return false;
+   }
+
+   if (this->level >= this->numberLevels) {
+      printf ("Unexpected process level: %u\n", this->level);
+      return false;
+   }
+
+   // First check for a pending interrupt request.
+   // Only level 0 can get interrupted - it was a design error.
+   if ((this->level == 0) && !this->current->k &&
+       __atomic_exchange_n (&this->interruptRequested, false, __ATOMIC_RELAXED))
+   {
+      // Switch to level 1, having cleared the request.
       //
-      case 0xC0:
-      case 0xC1:
-         JUMP(true, P);
-         break;
+      this->setLevel (1);
+   }
+
+   // Apply any memory mapping change posted by mappingModified.
+   //
+   if (__atomic_load_n (&this->mappingPosted, __ATOMIC_ACQUIRE)) this->applyMapping ();
+
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+bool ALP_Processor::execute()
+{
+   if (!this->prepareToExecute()) return false;
+
+   const Registers* const regs = this->current;   // Many macros assume regs exists.
+   const Int16 address = PREG;
+
+   // Fetch - use the predecoded instruction if we can.
+   // The I/O page (=X7000 to =X7FFF) is not memory, so never cached.
+   //
+   Decoded* decoded = &this->decodeCache [(address >> 1) & 0x7FFF];
+   Decoded ioDecoded;
+   if (!loadRelaxed (&decoded->isValid)) {
+      if ((address & 0xF000) == 0x7000) {
+         decoded = &ioDecoded;
+         this->decode (this->fetchWord (address), *decoded);
+      } else {
+         this->decodeEntry (address, *decoded);
+      }
+   }
 
-      case 0xC2:
-      case 0xC3:
-         JUMP(true, R);
-         break;
+   if (this->debug) {
+      printf ("%04X   B:%d   %+3d\n", decoded->instruction & 0xFFFF,
+              !decoded->isWord, decoded->offset);
+   }
+
+   if (this->opcodeCounts) {
+      this->opcodeCounts [(decoded->instruction >> 8) & 255]++;
+   }
 
-      case 0xC4:
-      case 0xC5:
-         JUMP(true, S);
-         break;
+   if (this->addressCounts) {
+      this->addressCounts [(address >> 1) & 0x7FFF]++;
+   }
+
+   if (this->trace) return this->traceExecute (decoded, address);
+
+   // Execute the instruction
+   //
+   int count;
+   return this->dispatch (decoded, 1, count);
+}
+
+//------------------------------------------------------------------------------
+// Executes the instruction and records it in the trace buffer.
+//
+bool ALP_Processor::traceExecute (const Decoded* decoded, const Int16 address)
+{
+   const unsigned int executeLevel = this->level;
+   const Registers* regs = this->current;
+   const UInt8 msiByte = (decoded->instruction >> 8) & 255;
 
-      case 0xC6:
-      case 0xC7:
-         JUMP(true, T);
-         break;
+   // The memory operand, if any, is as per ACCESS and JUMP, i.e. the index
+   // register plus the offset, P having been advanced. Conditional jumps are
+   // always P relative, and direct jumps have no memory operand.
+   //
+   const bool isConditional = (msiByte >= 0xD0) && (msiByte <= 0xD7);
+   const bool isJump = (msiByte >= 0xC0) && (msiByte <= 0xD7);
+   const bool isMemory = (msiByte < 0xC0) || ((msiByte >= 0xD8) && (msiByte <= 0xDF));
+   const bool hasOperand = isMemory || (isJump && !decoded->isWord);
+
+   Int16 operand = 0;
+   if (hasOperand) {
+      const Int16 indexValues [4] = { Int16 (address + 2), RREG, SREG, TREG };
+      const int index = isConditional ? 0 : (msiByte >> 1) & 3;
+      operand = indexValues [index] + decoded->offset;
+   }
 
+   int count;
+   const bool status = this->dispatch (decoded, 1, count);
+
+   regs = &this->registers [executeLevel];
+   TraceBuffer::Record* record = this->trace->next ();
+   record->p = address;
+   record->instruction = decoded->instruction;
+   record->a = AREG;
+   record->r = RREG;
+   record->s = SREG;
+   record->t = TREG;
+   record->operand = operand;
+   record->level = executeLevel;
+   record->flags = hasOperand ? TraceBuffer::hasOperand : 0;
+
+   return status;
+}
 
-      // JS
+//------------------------------------------------------------------------------
+// Block translation
+//------------------------------------------------------------------------------
+// Translates a straight-line run of instructions, up to and including the
+// next J, JS or conditional jump (=XC0 to =XD7), into threaded code, i.e. a
+// sequence of handlers with their pre-calculated operands.
+// We also end the block on the shift/special op codes (=XFF), as SETL et al.
+// change the level, and hence P, and/or interrupt handling.
+//
+ALP_Processor::Block* ALP_Processor::translate (const Int16 start)
+{
+   Block* block = new Block;
+   block->start = start;
+   block->length = 0;
+   block->entries = 0;
+   block->native = nullptr;
+   block->nativeLength = 0;
+   block->nativeLevel = 0;
+
+   Int16 address = start;
+   while (block->length < maximumBlockLength) {
+      // The I/O page (=X7000 to =X7FFF) is not memory - never translated.
       //
-      case 0xC8:
-      case 0xC9:
-         JUMP(true, P);
-         SETS(address + 2);
-         break;
-
-      case 0xCA:
-      case 0xCB:
-         JUMP(true, R);
-         SETS(address + 2);
-         break;
-
-      case 0xCC:
-      case 0xCD:
-         JUMP(true, S);
-         SETS(address + 2);
-         break;
-
-      case 0xCE:
-      case 0xCF:
-         JUMP(true, T);
-         SETS(address + 2);
-         break;
-
-
-      // JVS/JLT
+      if ((address & 0xF000) == 0x7000) break;
+
+      // Run checks for the stop address and break points between blocks.
       //
-      case 0xD0:
-      case 0xD1:
-         JUMP(VTRG,  P);
-         break;
+      if ((block->length > 0) &&
+          ((this->hasStopAddress && (address == this->stopAddress)) ||
+           (this->diagnostics && this->diagnostics->isBreakPoint (address)))) break;
 
-      // JVN/JGE
+      // Set coverage first, so that any concurrent modification by another
+      // processor thread is not missed.
       //
-      case 0xD2:
-      case 0xD3:
-         JUMP(!VTRG, P);
-         break;
+      storeRelaxed (&this->blockCoverage [(address >> 1) & 0x7FFF], true);
+      Decoded& decoded = block->code [block->length++];
+      this->decode (this->fetchWord (address), decoded);
 
-      // JCS/JEQ
+      const UInt8 msiByte = (decoded.instruction >> 8) & 255;
+      if ((msiByte >= 0xC0) && (msiByte <= 0xD7)) break;   // jumps
+      if (msiByte == 0xFF) break;                          // specials
+
+      address += 2;
+   }
+
+   const int index = (start >> 1) & 0x7FFF;
+   this->blockCache [index] = block;
+   this->blockStarts.push_back (index);
+   return block;
+}
+
+//------------------------------------------------------------------------------
+//
+void ALP_Processor::flushBlocks ()
+{
+   for (size_t j = 0; j < this->blockStarts.size(); j++) {
+      const int index = this->blockStarts [j];
+      Block* block = this->blockCache [index];
+      for (int k = 0; k < block->length; k++) {
+         storeRelaxed (&this->blockCoverage [(index + k) & 0x7FFF], false);
+      }
+      this->blockCache [index] = nullptr;
+      delete block;
+   }
+   this->blockStarts.clear();
+   storeRelaxed (&this->blocksStale, false);
+
+   // Any native code belonged to the blocks just discarded.
+   //
+   if (this->jit) this->jit->reset ();
+}
+
+//------------------------------------------------------------------------------
+//
+bool ALP_Processor::executeBlock (const int maxInstructions, int& count)
+{
+   count = 0;
+   if (!this->prepareToExecute()) return false;
+
+   // Discard all blocks if any translated instruction has been modified.
+   // We don't do this mid-block, we just stop executing the block.
+   //
+   if (loadRelaxed (&this->blocksStale)) this->flushBlocks ();
+
+   const Int16 start = this->getPreg();
+   if ((start & 0xF000) == 0x7000) {
+      count = 1;
+      return this->execute();
+   }
+
+   Block* block = this->blockCache [(start >> 1) & 0x7FFF];
+   if (!block) block = this->translate (start);
+
+   if (this->jit) {
+      // Compile hot blocks. When the code buffer is full we discard all the
+      // blocks, and hence the native code, and start again.
       //
-      case 0xD4:
-      case 0xD5:
-         JUMP(CTRG,  P);
-         break;
+      block->entries++;
+      if (block->entries == nativeThreshold) {
+         if (this->jit->isFull ()) {
+            this->blocksStale = true;
+         } else {
+            this->jit->compile (block);
+         }
+      }
 
-      // JCN/JNE
+      // The native code is compiled for a specific level and start address
+      // (an odd P shares the block of the even address), and runs to the end
+      // of the compiled instructions unless it exits early.
       //
-      case 0xD6:
-      case 0xD7:
-         JUMP(!CTRG, P);
-         break;
+      if (block->native && (block->nativeLevel == this->level) &&
+          (block->start == start) && (block->nativeLength <= maxInstructions))
+      {
+         count = block->native (this);
+         if (count > 0) return true;
+      }
+   }
 
+   const int number = MIN (block->length, maxInstructions);
+   return this->dispatch (block->code, number, count);
+}
 
-      // MLT
-      //
-      case 0xD8:
-      case 0xD9:
-         MLTA_Y(P);
-         break;
 
-      case 0xDA:
-      case 0xDB:
-         MLTA_Y(R);
-         break;
+//------------------------------------------------------------------------------
+// Batched execution
+//------------------------------------------------------------------------------
+//
+ALP_Processor::RunStatus ALP_Processor::run (const int maxInstructions, int& count)
+{
+   // Break points are checked before each instruction, other than the first,
+   // and blocks end before each break point, so that is between blocks.
+   // Opcodes and addresses are counted and traced by execute, so we only use
+   // the block translator when there is no counting and no tracing.
+   //
+   const bool checkBreakPoints = this->diagnostics &&
+                                 this->diagnostics->hasBreakPoints();
+   const bool useBlocks = !this->opcodeCounts &&
+                          !this->addressCounts && !this->trace &&
+                          (this->engine != interpreter);
+
+   this->pendingEvent = completed;
+   this->watchHitPending = false;
+   count = 0;
+   while (count < maxInstructions) {
+      const Int16 before = this->getPreg();
+      int number = 1;
+      bool status;
+      if (useBlocks) {
+         status = this->executeBlock (maxInstructions - count, number);
+      } else {
+         status = this->execute ();
+      }
+      count += number;
+
+      if (!status) return failed;
+
+      if (this->pendingEvent != completed) {
+         // A watch point hit may have been followed by another event, e.g.
+         // an I/O page write, later in the same block.
+         //
+         const RunStatus result = this->watchHitPending ? breakPoint : this->pendingEvent;
+         this->pendingEvent = completed;
+         this->idleLoop.matches = 0;
+         return result;
+      }
+
+      if (this->idleLoop.since <= maximumIdleLoopLength) this->idleLoop.since += number;
+
+      if (this->fastForward && !this->ioQueue) {
+         // Any loop - the loop points are the backward jumps, and any reads
+         // within the loop must be idle polls. Fast forward does not apply
+         // when running on our own host thread.
+         //
+         if (this->slowRead) {
+            this->slowRead = false;
+            this->idleLoop.busy |= !this->dataBus->isIdlePoll (this->slowReadAddress,
+                                                               this->idleLoop.pollFd);
+         }
+         if ((this->getPreg() <= before) &&
+             this->checkIdleLoop (0, !this->idleLoop.busy)) return idle;
+
+      } else if (this->slowRead) {
+         // Polling loops only - the loop points are the slow reads.
+         //
+         this->slowRead = false;
+         const bool isIdlePoll = this->busIsIdlePoll (this->slowReadAddress,
+                                                      this->idleLoop.pollFd);
+         if (this->checkIdleLoop (this->slowReadAddress, isIdlePoll)) return idle;
+      }
+
+      if (this->hasStopAddress && (count < maxInstructions) &&
+          (this->getPreg() == this->stopAddress))
+      {
+         return atStopAddress;
+      }
+
+      if (checkBreakPoints && (count < maxInstructions) &&
+          this->diagnostics->isBreakPoint (this->getPreg()) &&
+          this->testBreakCondition ())
+      {
+         return breakPoint;
+      }
+   }
+
+   return completed;
+}
 
-      case 0xDC:
-      case 0xDD:
-         MLTA_Y(S);
-         break;
+//------------------------------------------------------------------------------
+//
+bool ALP_Processor::isAtBreakPoint () const
+{
+   return this->diagnostics &&
+          this->diagnostics->isBreakPoint (this->getPreg()) &&
+          this->testBreakCondition ();
+}
 
-      case 0xDE:
-      case 0xDF:
-         MLTA_Y(T);
-         break;
+//------------------------------------------------------------------------------
+// Existing blocks may run through the new stop address.
+//
+void ALP_Processor::setStopAddress (const int address)
+{
+   this->hasStopAddress = (address >= 0);
+   this->stopAddress = Int16 (address);
+   storeRelaxed (&this->blocksStale, true);
+}
 
+//------------------------------------------------------------------------------
+//
+bool ALP_Processor::isAtStopAddress () const
+{
+   return this->hasStopAddress && (this->getPreg() == this->stopAddress);
+}
 
-      // LITerals
-      //
-      case 0xE0:
-         SETX(A, lsiByte);
-         break;
+//------------------------------------------------------------------------------
+// Only called at a break point address, so the triggers are only evaluated
+// then.
+//
+bool ALP_Processor::testBreakCondition () const
+{
+   const Registers* const regs = this->current;
+
+   BreakCondition::State state;
+   state.p = PREG;
+   state.a = AREG;
+   state.r = RREG;
+   state.s = SREG;
+   state.t = TREG;
+   state.level = this->level;
+   state.c = ALP_Processor::getCTrigger (regs);
+   state.v = ALP_Processor::getVTrigger (regs);
+   state.k = KFLG;
+
+   return this->diagnostics->testBreak (state);
+}
+
+//------------------------------------------------------------------------------
+//
+void ALP_Processor::getIdleWait (int& fd, int& loopLength) const
+{
+   fd = this->idleLoop.fd;
+   loopLength = MAX (this->idleLoop.length, 1);
+}
+
+//------------------------------------------------------------------------------
+// Called at each loop point, isIdle indicates the loop iteration that has just
+// completed did nothing but idle polling (if anything).
+//
+bool ALP_Processor::checkIdleLoop (const Int16 address, const bool isIdle)
+{
+   const Registers* const regs = this->current;
+   IdleLoop& loop = this->idleLoop;
+   const Registers& was = loop.registers;
+
+   const bool same = isIdle &&
+                     (address == loop.address) &&
+                     (loop.since <= maximumIdleLoopLength) &&
+                     (loop.since == loop.length) &&
+                     (this->busWrites == loop.busWrites) &&
+                     (this->level == loop.level) &&
+                     (PREG == was.p) &&
+                     (AREG == was.a) &&
+                     (RREG == was.r) &&
+                     (SREG == was.s) &&
+                     (TREG == was.t) &&
+                     (KFLG == was.k) &&
+                     (regs->triggerKind == was.triggerKind) &&
+                     (regs->triggerA == was.triggerA) &&
+                     (regs->triggerB == was.triggerB) &&
+                     (regs->c == was.c) &&
+                     (regs->v == was.v);
+
+   loop.matches = same ? loop.matches + 1 : 0;
+   loop.address = address;
+   loop.length = loop.since;
+   loop.since = 0;
+   loop.busWrites = this->busWrites;
+   loop.level = this->level;
+   loop.registers = *regs;
+   loop.fd = loop.pollFd;
+   loop.pollFd = -1;
+   loop.busy = false;
+
+   return loop.matches >= idleLoopThreshold;
+}
+
+
+//------------------------------------------------------------------------------
+// Instruction handlers
+//------------------------------------------------------------------------------
+//
+// Macro funtions - these all expect regs, decoded and address to exist,
+// and the memory reference macros also expect isWord, a compile time constant.
+//
+#define UNDEFINED {                                                           \
+   printf ("Undefined instruction: (%04X) %04X\n",                            \
+           address & 0xFFFF, decoded.instruction & 0xFFFF);                   \
+   return false;                                                              \
+}
+
+
+// A write to the I/O page may change the clock, the memory mapping etc.,
+// so this is notified to run's caller.
+//
+#define STRX_Y(x,y)  {                                                        \
+   const Int16 addr = y##REG + decoded.offset;                                \
+   this->writeMemory <isWord> (addr, x##REG);                                 \
+   if ((addr & 0xF000) == 0x7000) this->pendingEvent = deviceEvent;           \
+}
+
+
+// Basic operations
+// Trigger association is kind of speculitive.
+//
+#define SETX(x, regvalue) {                                                   \
+   SET##x(regvalue);                                                          \
+   DEFER_TRIGGERS (compareTriggers, x##REG, 0);                               \
+}
 
-      case 0xE1:
-         ADDX(A, lsiByte);
-         break;
 
-      case 0xE2:
-         SUBX(A, lsiByte);
-         break;
+#define ADDX(x, operand) {                                                    \
+   const int t = x##REG + (operand);                                          \
+   SET##x(t);                                                                 \
+   DEFER_TRIGGERS (arithmeticTriggers, t, 0);                                 \
+}
+
+
+#define SUBX(x, operand) {                                                    \
+   const int t = x##REG - (operand);                                          \
+   SET##x(t);                                                                 \
+   DEFER_TRIGGERS (arithmeticTriggers, t, 0);                                 \
+}
+
+
+// TODO: verify which JxC/JxN corresponds to == and <
+//
+#define CMPX(x, operand) {                                                    \
+   DEFER_TRIGGERS (compareTriggers, x##REG, operand);                         \
+}
+
 
-      case 0xE3:
-         CMPX(A, lsiByte);
-         break;
+#define ANDX(x, operand)  SET##x(x##REG & (operand))
 
-      case 0xE4:
-         ANDX(A, lsiByte);
-         break;
+#define IORX(x, operand)  SET##x(x##REG | (operand))
 
-      case 0xE5:
-         NEQX(A, lsiByte);
-         break;
+#define NEQX(x, operand)  SET##x(x##REG ^ (operand))
 
-      case 0xE6:
-         IORX(A, lsiByte);
-         break;
-
-      // case 0xE7 - see below
-
-      case 0xE8:
-         SETX(R, lsiByte);
-         break;
 
-      case 0xE9:
-         ADDX(R, lsiByte);
-         break;
+#define ACCESS(y) (this->readMemory <isWord> (y##REG + decoded.offset))
 
-      case 0xEA:
-         SUBX(R, lsiByte);
-         break;
 
-      case 0xEB:
-         CMPX(R, lsiByte);
-         break;
-
-      case 0xEC:
-         ANDX(R, lsiByte);
-         break;
-
-      case 0xED:
-         NEQX(R, lsiByte);
-         break;
-
-      case 0xEE:
-         IORX(R, lsiByte);
-         break;
-
-      // case 0xEF - see below
-
-      case 0xF0:
-         SETX(S, lsiByte);
-         break;
-
-      case 0xF1:
-         ADDX(S, lsiByte);
-         break;
-
-      case 0xF2:
-         SUBX(S, lsiByte);
-         break;
-
-      case 0xF3:
-         CMPX(S, lsiByte);
-         break;
-
-      case 0xF4:
-         ANDX(S, lsiByte);
-         break;
-
-      case 0xF5:
-         NEQX(S, lsiByte);
-         break;
-
-      case 0xF6:
-         IORX(S, lsiByte);
-         break;
-
-      // case 0xF7 - see below
-
-      case 0xF8:
-         // For T we go direct - no trigger setting
-         SETT(lsiByte);
-         break;
-
-      case 0xF9:
-         ADDX(T, lsiByte);
-         break;
-
-      case 0xFA:
-         SUBX(T, lsiByte);
-         break;
-
-      case 0xFB:
-         CMPX(T, lsiByte);
-         break;
-
-      case 0xFC:
-         ANDX(T, lsiByte);
-         break;
-
-      case 0xFD:
-         NEQX(T, lsiByte);
-         break;
-
-      case 0xFE:
-         IORX(T, lsiByte);
-         break;
-
-      case 0xE7:  // Shifts
-      case 0xEF:  // Shifts
-      case 0xF7:  // Shifts
-      case 0xFF:  // Shifts and specials.
-         {
-            if ((lsiByte & 0xC0) == 0x40) {
-               // This is a shift
-               // All verfy speculative
-               //
-               enum Dirn { left = 0, right = 1};
-               enum Mode { logical = 0, arithmetic = 1 };
-
-               const bool cTrigWasSet = CTRG;
-
-               const int reg = (msiByte >> 3) & 3;
-               const Dirn leftRight         = Dirn ((lsiByte >> 5) & 1);
-               const Mode logicalArithmetic = Mode ((lsiByte >> 4) & 1);
-
-               int shift = lsiByte & 0x0F;
-               bool coupled = false;
-
-               if (shift == 0) {
-                  if (logicalArithmetic == arithmetic) {
-                     // shift 0 impiles 1,LC ; 1,AC not allowed
-                     UNDEFINED;
-                     break;
-                  }
-                  coupled = 1;
-                  shift = 1;
-               }
-
-               Int16 regValue;
-               switch (reg) {
-                  case 0: regValue = AREG; break;
-                  case 1: regValue = RREG; break;
-                  case 2: regValue = SREG; break;
-                  case 3: regValue = TREG; break;
-               }
-
-               if (leftRight == left) {
-                  regValue = regValue << (shift - 1);
-                  CTRG = (regValue & 0x8000) == 0x8000;  // Extract last bit to be shifted.
-                  regValue = regValue << 1;
-                  if (coupled && cTrigWasSet) {
-                     regValue |= 0x0001;
-                  }
-               } else {
-                  regValue = regValue >> (shift - 1);    // naturally arithmetic
-                  CTRG = (regValue & 0x0001) == 0x0001;  // Extract last bit to be shifted.
-                  regValue = regValue >> 1;
-                  if (coupled && cTrigWasSet) {
-                     regValue |= 0x8000;
-                  }
-
-                  if (logicalArithmetic == logical) {
-                     unsigned long mask = 0x0000FFFF >> shift;
-                     regValue = regValue & mask;
-                  }
-               }
-
-               switch (reg) {
-                  case 0: SETA(regValue); break;
-                  case 1: SETR(regValue); break;
-                  case 2: SETS(regValue); break;
-                  case 3: SETT(regValue); break;
-               }
-
-               break;
-            }
-
-            // Check other specials
-            //
-            if (msiByte == 0xFF) {
-               // ALP1 has 4 levels, ALP2 has two levels
-               if (lsiByte < this->numberLevels) {
-                  // SETL  XX
-                  this->level = lsiByte;
-
-               } else if (lsiByte == 0x20) {
-                  // CLRK
-                  KFLG = false;
-
-               } else if (lsiByte == 0x21) {
-                  // SETK
-                  KFLG = true;
-
-               } else if (lsiByte == 0xFF) {
-                  // NUL
-
-               } else {
-                  UNDEFINED;
-               }
-            }
+#define SETX_Y(x,y)  SETX(x, ACCESS(y))
+#define SETT_Y(  y)  SETT(   ACCESS(y))
+#define ADDX_Y(x,y)  ADDX(x, ACCESS(y))
+#define SUBX_Y(x,y)  SUBX(x, ACCESS(y))
+#define CMPX_Y(x,y)  CMPX(x, ACCESS(y))
+#define ANDX_Y(x,y)  ANDX(x, ACCESS(y))
+#define IORX_Y(x,y)  IORX(x, ACCESS(y))
+#define NEQX_Y(x,y)  NEQX(x, ACCESS(y))
+
+
+#define MLTA_Y(y) {                                                           \
+   long t = AREG * ACCESS(y) * 2;                                             \
+   SETA(t >> 16);                                                             \
+   SETR(t);                                                                   \
+}
+
+
+// General Jump macro
+// For jumps, byte mode selects indirect.
+//
+#define JUMP(condition, index) {                                              \
+   if (condition) {                                                           \
+      if (!isWord) {                                                          \
+         SETP(this->readMemory <true> (index##REG + decoded.offset));         \
+      } else {                                                                \
+         SETP(index##REG + decoded.offset);                                   \
+      }                                                                       \
+   }                                                                          \
+}
+
+
+// These are not independent instructions.
+// #define JEZX(x)      JUMP(x##REG == 0, P)
+// #define JNZX(x)      JUMP(x##REG != 0, P)
+// #define JPZX(x)      JUMP(x##REG >= 0, P)
+// #define JNGX(x)      JUMP(x##REG <  0, P)
+
+
+// Defines the handler for the specified op code and word/byte variant.
+//
+#define VARIANT(opcode, word, action)                                         \
+template <> inline                                                            \
+bool ALP_Processor::handler <opcode, word> (const Decoded& decoded,           \
+                                            const Int16 address)              \
+{                                                                             \
+   constexpr bool isWord = word;                                              \
+   Registers* const regs = this->current;                                     \
+   action;                                                                    \
+   return true;                                                               \
+}
+
+// Defines the word and byte handlers for the specified memory reference
+// op code, and by implication, the next op code also (the sign bit).
+//
+#define HANDLER(opcode, action)                                               \
+   VARIANT(opcode, true, action)                                              \
+   VARIANT(opcode, false, action)
+
+// Defines the handler for the specified literal op code.
+// Here the lsi byte is not a memory offset, so there is no byte variant.
+//
+#define LITERAL(opcode, action)                                               \
+   VARIANT(opcode, true, (void) isWord; action)
+
+//------------------------------------------------------------------------------
+// Shifts (=XE7, =XEF, =XF7 and =XFF) and specials (=XFF).
+//
+// The register is op code bits 3 and 4, i.e. A, R, S and T respectively.
+//
+template <int opcode>
+inline bool ALP_Processor::shiftOrSpecial (const Decoded& decoded,
+                                           const Int16 address)
+{
+   Registers* const regs = this->current;
+   const UInt8 lsiByte = decoded.lsiByte;
+
+   if ((lsiByte & 0xC0) == 0x40) {
+      // This is a shift
+      // All verfy speculative
+      //
+      enum Dirn { left = 0, right = 1};
+      enum Mode { logical = 0, arithmetic = 1 };
+
+      const bool cTrigWasSet = CTRG;
+
+      constexpr int reg = (opcode >> 3) & 3;
+      const Dirn leftRight         = Dirn ((lsiByte >> 5) & 1);
+      const Mode logicalArithmetic = Mode ((lsiByte >> 4) & 1);
+
+      int shift = lsiByte & 0x0F;
+      bool coupled = false;
+
+      if (shift == 0) {
+         if (logicalArithmetic == arithmetic) {
+            // shift 0 impiles 1,LC ; 1,AC not allowed
+            UNDEFINED;
+         }
+         coupled = 1;
+         shift = 1;
+      }
+
+      Int16 regValue = 0;
+      switch (reg) {
+         case 0: regValue = AREG; break;
+         case 1: regValue = RREG; break;
+         case 2: regValue = SREG; break;
+         case 3: regValue = TREG; break;
+      }
+
+      if (leftRight == left) {
+         regValue = regValue << (shift - 1);
+         SET_TRIGGERS ((regValue & 0x8000) == 0x8000, VTRG);  // Extract last bit to be shifted.
+         regValue = regValue << 1;
+         if (coupled && cTrigWasSet) {
+            regValue |= 0x0001;
          }
-         break;
+      } else {
+         regValue = regValue >> (shift - 1);    // naturally arithmetic
+         SET_TRIGGERS ((regValue & 0x0001) == 0x0001, VTRG);  // Extract last bit to be shifted.
+         regValue = regValue >> 1;
+         if (coupled && cTrigWasSet) {
+            regValue |= 0x8000;
+         }
+
+         if (logicalArithmetic == logical) {
+            unsigned long mask = 0x0000FFFF >> shift;
+            regValue = regValue & mask;
+         }
+      }
+
+      switch (reg) {
+         case 0: SETA(regValue); break;
+         case 1: SETR(regValue); break;
+         case 2: SETS(regValue); break;
+         case 3: SETT(regValue); break;
+      }
+
+      return true;
+   }
 
-      default:
+   // Check other specials
+   //
+   if (opcode == 0xFF) {
+      // ALP1 has 4 levels, ALP2 has two levels
+      if (lsiByte < this->numberLevels) {
+         // SETL  XX
+         this->setLevel (lsiByte);
+
+      } else if (lsiByte == 0x20) {
+         // CLRK
+         KFLG = false;
+
+      } else if (lsiByte == 0x21) {
+         // SETK
+         KFLG = true;
+
+      } else if (lsiByte == 0xFF) {
+         // NUL
+
+      } else {
          UNDEFINED;
-         break;
+      }
    }
 
    return true;
 }
 
+#define SHIFT(opcode)                                                         \
+template <> inline                                                            \
+bool ALP_Processor::handler <opcode, true> (const Decoded& decoded,           \
+                                            const Int16 address)              \
+{                                                                             \
+   return this->shiftOrSpecial <opcode> (decoded, address);                   \
+}
+
+namespace L16E {
+
+// SET i.e. LOAD
+//
+HANDLER (0x00, SETX_Y(A, P))
+HANDLER (0x02, SETX_Y(A, R))
+HANDLER (0x04, SETX_Y(A, S))
+HANDLER (0x06, SETX_Y(A, T))
+HANDLER (0x08, SETX_Y(R, P))
+HANDLER (0x0A, SETX_Y(R, R))
+HANDLER (0x0C, SETX_Y(R, S))
+HANDLER (0x0E, SETX_Y(R, T))
+HANDLER (0x10, SETX_Y(S, P))
+HANDLER (0x12, SETX_Y(S, R))
+HANDLER (0x14, SETX_Y(S, S))
+HANDLER (0x16, SETX_Y(S, T))
+HANDLER (0x18, SETT_Y(P))
+HANDLER (0x1A, SETT_Y(R))
+HANDLER (0x1C, SETT_Y(S))
+HANDLER (0x1E, SETT_Y(T))
+
+// STR
+//
+HANDLER (0x20, STRX_Y(A, P))
+HANDLER (0x22, STRX_Y(A, R))
+HANDLER (0x24, STRX_Y(A, S))
+HANDLER (0x26, STRX_Y(A, T))
+HANDLER (0x28, STRX_Y(R, P))
+HANDLER (0x2A, STRX_Y(R, R))
+HANDLER (0x2C, STRX_Y(R, S))
+HANDLER (0x2E, STRX_Y(R, T))
+HANDLER (0x30, STRX_Y(S, P))
+HANDLER (0x32, STRX_Y(S, R))
+HANDLER (0x34, STRX_Y(S, S))
+HANDLER (0x36, STRX_Y(S, T))
+HANDLER (0x38, STRX_Y(T, P))
+HANDLER (0x3A, STRX_Y(T, R))
+HANDLER (0x3C, STRX_Y(T, S))
+HANDLER (0x3E, STRX_Y(T, T))
+
+// ADD
+//
+HANDLER (0x40, ADDX_Y(A, P))
+HANDLER (0x42, ADDX_Y(A, R))
+HANDLER (0x44, ADDX_Y(A, S))
+HANDLER (0x46, ADDX_Y(A, T))
+HANDLER (0x48, ADDX_Y(R, P))
+HANDLER (0x4A, ADDX_Y(R, R))
+HANDLER (0x4C, ADDX_Y(R, S))
+HANDLER (0x4E, ADDX_Y(R, T))
+HANDLER (0x50, ADDX_Y(S, P))
+HANDLER (0x52, ADDX_Y(S, R))
+HANDLER (0x54, ADDX_Y(S, S))
+HANDLER (0x56, ADDX_Y(S, T))
+HANDLER (0x58, ADDX_Y(T, P))
+HANDLER (0x5A, ADDX_Y(T, R))
+HANDLER (0x5C, ADDX_Y(T, S))
+HANDLER (0x5E, ADDX_Y(T, T))
+
+// CMP
+//
+HANDLER (0x60, CMPX_Y(A, P))
+HANDLER (0x62, CMPX_Y(A, R))
+HANDLER (0x64, CMPX_Y(A, S))
+HANDLER (0x66, CMPX_Y(A, T))
+HANDLER (0x68, CMPX_Y(R, P))
+HANDLER (0x6A, CMPX_Y(R, R))
+HANDLER (0x6C, CMPX_Y(R, S))
+HANDLER (0x6E, CMPX_Y(R, T))
+HANDLER (0x70, CMPX_Y(S, P))
+HANDLER (0x72, CMPX_Y(S, R))
+HANDLER (0x74, CMPX_Y(S, S))
+HANDLER (0x76, CMPX_Y(S, T))
+HANDLER (0x78, CMPX_Y(T, P))
+HANDLER (0x7A, CMPX_Y(T, R))
+HANDLER (0x7C, CMPX_Y(T, S))
+HANDLER (0x7E, CMPX_Y(T, T))
+
+// SUB
+//
+HANDLER (0x80, SUBX_Y(A, P))
+HANDLER (0x82, SUBX_Y(A, R))
+HANDLER (0x84, SUBX_Y(A, S))
+HANDLER (0x86, SUBX_Y(A, T))
+HANDLER (0x88, SUBX_Y(R, P))
+HANDLER (0x8A, SUBX_Y(R, R))
+HANDLER (0x8C, SUBX_Y(R, S))
+HANDLER (0x8E, SUBX_Y(R, T))
+
+// AND/MASK
+//
+HANDLER (0x90, ANDX_Y(A, P))
+HANDLER (0x92, ANDX_Y(A, R))
+HANDLER (0x94, ANDX_Y(A, S))
+HANDLER (0x96, ANDX_Y(A, T))
+HANDLER (0x98, ANDX_Y(R, P))
+HANDLER (0x9A, ANDX_Y(R, R))
+HANDLER (0x9C, ANDX_Y(R, S))
+HANDLER (0x9E, ANDX_Y(R, T))
+
+// NEQ/XOR
+//
+HANDLER (0xA0, NEQX_Y(A, P))
+HANDLER (0xA2, NEQX_Y(A, R))
+HANDLER (0xA4, NEQX_Y(A, S))
+HANDLER (0xA6, NEQX_Y(A, T))
+HANDLER (0xA8, NEQX_Y(R, P))
+HANDLER (0xAA, NEQX_Y(R, R))
+HANDLER (0xAC, NEQX_Y(R, S))
+HANDLER (0xAE, NEQX_Y(R, T))
+
+// IOR
+//
+HANDLER (0xB0, IORX_Y(A, P))
+HANDLER (0xB2, IORX_Y(A, R))
+HANDLER (0xB4, IORX_Y(A, S))
+HANDLER (0xB6, IORX_Y(A, T))
+HANDLER (0xB8, IORX_Y(R, P))
+HANDLER (0xBA, IORX_Y(R, R))
+HANDLER (0xBC, IORX_Y(R, S))
+HANDLER (0xBE, IORX_Y(R, T))
+
+// J
+//
+HANDLER (0xC0, JUMP(true, P))
+HANDLER (0xC2, JUMP(true, R))
+HANDLER (0xC4, JUMP(true, S))
+HANDLER (0xC6, JUMP(true, T))
+
+// JS
+//
+HANDLER (0xC8, JUMP(true, P); SETS(address + 2))
+HANDLER (0xCA, JUMP(true, R); SETS(address + 2))
+HANDLER (0xCC, JUMP(true, S); SETS(address + 2))
+HANDLER (0xCE, JUMP(true, T); SETS(address + 2))
+
+// JVS/JLT
+//
+HANDLER (0xD0, JUMP(VTRG,  P))
+
+// JVN/JGE
+//
+HANDLER (0xD2, JUMP(!VTRG, P))
+
+// JCS/JEQ
+//
+HANDLER (0xD4, JUMP(CTRG,  P))
+
+// JCN/JNE
+//
+HANDLER (0xD6, JUMP(!CTRG, P))
+
+// MLT
+//
+HANDLER (0xD8, MLTA_Y(P))
+HANDLER (0xDA, MLTA_Y(R))
+HANDLER (0xDC, MLTA_Y(S))
+HANDLER (0xDE, MLTA_Y(T))
+
+// LITerals
+//
+LITERAL (0xE0, SETX(A, decoded.lsiByte))
+LITERAL (0xE1, ADDX(A, decoded.lsiByte))
+LITERAL (0xE2, SUBX(A, decoded.lsiByte))
+LITERAL (0xE3, CMPX(A, decoded.lsiByte))
+LITERAL (0xE4, ANDX(A, decoded.lsiByte))
+LITERAL (0xE5, NEQX(A, decoded.lsiByte))
+LITERAL (0xE6, IORX(A, decoded.lsiByte))
+SHIFT (0xE7)
+
+LITERAL (0xE8, SETX(R, decoded.lsiByte))
+LITERAL (0xE9, ADDX(R, decoded.lsiByte))
+LITERAL (0xEA, SUBX(R, decoded.lsiByte))
+LITERAL (0xEB, CMPX(R, decoded.lsiByte))
+LITERAL (0xEC, ANDX(R, decoded.lsiByte))
+LITERAL (0xED, NEQX(R, decoded.lsiByte))
+LITERAL (0xEE, IORX(R, decoded.lsiByte))
+SHIFT (0xEF)
+
+LITERAL (0xF0, SETX(S, decoded.lsiByte))
+LITERAL (0xF1, ADDX(S, decoded.lsiByte))
+LITERAL (0xF2, SUBX(S, decoded.lsiByte))
+LITERAL (0xF3, CMPX(S, decoded.lsiByte))
+LITERAL (0xF4, ANDX(S, decoded.lsiByte))
+LITERAL (0xF5, NEQX(S, decoded.lsiByte))
+LITERAL (0xF6, IORX(S, decoded.lsiByte))
+SHIFT (0xF7)
+
+// For T we go direct - no trigger setting
+LITERAL (0xF8, SETT(decoded.lsiByte))
+LITERAL (0xF9, ADDX(T, decoded.lsiByte))
+LITERAL (0xFA, SUBX(T, decoded.lsiByte))
+LITERAL (0xFB, CMPX(T, decoded.lsiByte))
+LITERAL (0xFC, ANDX(T, decoded.lsiByte))
+LITERAL (0xFD, NEQX(T, decoded.lsiByte))
+LITERAL (0xFE, IORX(T, decoded.lsiByte))
+SHIFT (0xFF)
+
+
+//------------------------------------------------------------------------------
+// Op code map - for each instruction most significant byte, the op code of the
+// handler that executes it. Memory reference op code pairs differ only by the
+// offset sign, which decode has already applied.
+//
+#define OPCODE_MAP(PAIR, LIT)                                                 \
+   PAIR(0x00) PAIR(0x02) PAIR(0x04) PAIR(0x06)                                \
+   PAIR(0x08) PAIR(0x0A) PAIR(0x0C) PAIR(0x0E)                                \
+   PAIR(0x10) PAIR(0x12) PAIR(0x14) PAIR(0x16)                                \
+   PAIR(0x18) PAIR(0x1A) PAIR(0x1C) PAIR(0x1E)                                \
+   PAIR(0x20) PAIR(0x22) PAIR(0x24) PAIR(0x26)                                \
+   PAIR(0x28) PAIR(0x2A) PAIR(0x2C) PAIR(0x2E)                                \
+   PAIR(0x30) PAIR(0x32) PAIR(0x34) PAIR(0x36)                                \
+   PAIR(0x38) PAIR(0x3A) PAIR(0x3C) PAIR(0x3E)                                \
+   PAIR(0x40) PAIR(0x42) PAIR(0x44) PAIR(0x46)                                \
+   PAIR(0x48) PAIR(0x4A) PAIR(0x4C) PAIR(0x4E)                                \
+   PAIR(0x50) PAIR(0x52) PAIR(0x54) PAIR(0x56)                                \
+   PAIR(0x58) PAIR(0x5A) PAIR(0x5C) PAIR(0x5E)                                \
+   PAIR(0x60) PAIR(0x62) PAIR(0x64) PAIR(0x66)                                \
+   PAIR(0x68) PAIR(0x6A) PAIR(0x6C) PAIR(0x6E)                                \
+   PAIR(0x70) PAIR(0x72) PAIR(0x74) PAIR(0x76)                                \
+   PAIR(0x78) PAIR(0x7A) PAIR(0x7C) PAIR(0x7E)                                \
+   PAIR(0x80) PAIR(0x82) PAIR(0x84) PAIR(0x86)                                \
+   PAIR(0x88) PAIR(0x8A) PAIR(0x8C) PAIR(0x8E)                                \
+   PAIR(0x90) PAIR(0x92) PAIR(0x94) PAIR(0x96)                                \
+   PAIR(0x98) PAIR(0x9A) PAIR(0x9C) PAIR(0x9E)                                \
+   PAIR(0xA0) PAIR(0xA2) PAIR(0xA4) PAIR(0xA6)                                \
+   PAIR(0xA8) PAIR(0xAA) PAIR(0xAC) PAIR(0xAE)                                \
+   PAIR(0xB0) PAIR(0xB2) PAIR(0xB4) PAIR(0xB6)                                \
+   PAIR(0xB8) PAIR(0xBA) PAIR(0xBC) PAIR(0xBE)                                \
+   PAIR(0xC0) PAIR(0xC2) PAIR(0xC4) PAIR(0xC6)                                \
+   PAIR(0xC8) PAIR(0xCA) PAIR(0xCC) PAIR(0xCE)                                \
+   PAIR(0xD0) PAIR(0xD2) PAIR(0xD4) PAIR(0xD6)                                \
+   PAIR(0xD8) PAIR(0xDA) PAIR(0xDC) PAIR(0xDE)                                \
+   LIT(0xE0) LIT(0xE1) LIT(0xE2) LIT(0xE3)                                    \
+   LIT(0xE4) LIT(0xE5) LIT(0xE6) LIT(0xE7)                                    \
+   LIT(0xE8) LIT(0xE9) LIT(0xEA) LIT(0xEB)                                    \
+   LIT(0xEC) LIT(0xED) LIT(0xEE) LIT(0xEF)                                    \
+   LIT(0xF0) LIT(0xF1) LIT(0xF2) LIT(0xF3)                                    \
+   LIT(0xF4) LIT(0xF5) LIT(0xF6) LIT(0xF7)                                    \
+   LIT(0xF8) LIT(0xF9) LIT(0xFA) LIT(0xFB)                                    \
+   LIT(0xFC) LIT(0xFD) LIT(0xFE) LIT(0xFF)
+
+//------------------------------------------------------------------------------
+// The list of handler op codes, i.e. the distinct values in the above map.
+// Memory reference handlers have word and byte variants.
+//
+#define HANDLER_LIST(MEM, LIT)                                                \
+   MEM(0x00) MEM(0x02) MEM(0x04) MEM(0x06) MEM(0x08) MEM(0x0A) MEM(0x0C) MEM(0x0E)\
+   MEM(0x10) MEM(0x12) MEM(0x14) MEM(0x16) MEM(0x18) MEM(0x1A) MEM(0x1C) MEM(0x1E)\
+   MEM(0x20) MEM(0x22) MEM(0x24) MEM(0x26) MEM(0x28) MEM(0x2A) MEM(0x2C) MEM(0x2E)\
+   MEM(0x30) MEM(0x32) MEM(0x34) MEM(0x36) MEM(0x38) MEM(0x3A) MEM(0x3C) MEM(0x3E)\
+   MEM(0x40) MEM(0x42) MEM(0x44) MEM(0x46) MEM(0x48) MEM(0x4A) MEM(0x4C) MEM(0x4E)\
+   MEM(0x50) MEM(0x52) MEM(0x54) MEM(0x56) MEM(0x58) MEM(0x5A) MEM(0x5C) MEM(0x5E)\
+   MEM(0x60) MEM(0x62) MEM(0x64) MEM(0x66) MEM(0x68) MEM(0x6A) MEM(0x6C) MEM(0x6E)\
+   MEM(0x70) MEM(0x72) MEM(0x74) MEM(0x76) MEM(0x78) MEM(0x7A) MEM(0x7C) MEM(0x7E)\
+   MEM(0x80) MEM(0x82) MEM(0x84) MEM(0x86) MEM(0x88) MEM(0x8A) MEM(0x8C) MEM(0x8E)\
+   MEM(0x90) MEM(0x92) MEM(0x94) MEM(0x96) MEM(0x98) MEM(0x9A) MEM(0x9C) MEM(0x9E)\
+   MEM(0xA0) MEM(0xA2) MEM(0xA4) MEM(0xA6) MEM(0xA8) MEM(0xAA) MEM(0xAC) MEM(0xAE)\
+   MEM(0xB0) MEM(0xB2) MEM(0xB4) MEM(0xB6) MEM(0xB8) MEM(0xBA) MEM(0xBC) MEM(0xBE)\
+   MEM(0xC0) MEM(0xC2) MEM(0xC4) MEM(0xC6) MEM(0xC8) MEM(0xCA) MEM(0xCC) MEM(0xCE)\
+   MEM(0xD0) MEM(0xD2) MEM(0xD4) MEM(0xD6) MEM(0xD8) MEM(0xDA) MEM(0xDC) MEM(0xDE)\
+   LIT(0xE0) LIT(0xE1) LIT(0xE2) LIT(0xE3) LIT(0xE4) LIT(0xE5) LIT(0xE6) LIT(0xE7)\
+   LIT(0xE8) LIT(0xE9) LIT(0xEA) LIT(0xEB) LIT(0xEC) LIT(0xED) LIT(0xEE) LIT(0xEF)\
+   LIT(0xF0) LIT(0xF1) LIT(0xF2) LIT(0xF3) LIT(0xF4) LIT(0xF5) LIT(0xF6) LIT(0xF7)\
+   LIT(0xF8) LIT(0xF9) LIT(0xFA) LIT(0xFB) LIT(0xFC) LIT(0xFD) LIT(0xFE) LIT(0xFF)
+
+//------------------------------------------------------------------------------
+// Handler key to handler lookup table - used by decode.
+// The key is the msi byte and the lsi byte's byte flag, i.e. msiByte*2 + flag.
+// The handler is identified by its op code and the byte flag, similarly.
+//
+#define PAIR(opcode)  2*opcode, 2*opcode+1, 2*opcode, 2*opcode+1,
+#define LIT(opcode)   2*opcode, 2*opcode,
+
+const Int16 ALP_Processor::handlerMap [512] = {
+   OPCODE_MAP (PAIR, LIT)
+};
+
+#undef PAIR
+#undef LIT
+
+//------------------------------------------------------------------------------
+// Set up by the first call to dispatch.
+//
+const void* const* ALP_Processor::dispatchTable = nullptr;
+
+//------------------------------------------------------------------------------
+// Executes up to number pre-decoded instructions, stopping early if P does not
+// match the next instruction's expected address (e.g. after a jump, or a write
+// to the current level P register) or if the decoded code becomes stale.
+// Each handler jumps directly to the next handler (computed goto) instead of
+// returning to a central dispatch loop, which gives the host branch predictor
+// a separate indirect branch per handler.
+//
+bool ALP_Processor::dispatch (const Decoded* code, const int number, int& count)
+{
+#ifdef L16E_COMPUTED_GOTO
+#define PAIR(opcode)  &&op_##opcode##_w, &&op_##opcode##_b,                     \
+                      &&op_##opcode##_w, &&op_##opcode##_b,
+#define LIT(opcode)   &&op_##opcode##_w, &&op_##opcode##_w,
+
+   static const void* const labels [512] = {
+      OPCODE_MAP (PAIR, LIT)
+   };
+
+#undef PAIR
+#undef LIT
+
+   ALP_Processor::dispatchTable = labels;
+#define GOTO_NEXT     goto *decoded->target
+#else
+#define GOTO_NEXT     goto dispatchSwitch
+#endif
+
+   count = 0;
+   if (number <= 0) return true;
+
+   const Decoded* decoded;
+   Int16 address;
+   Int16 expected = this->getPreg ();
+
+   // Update P first-thing before executing the instruction proper.
+   //
+#define FETCH {                                                               \
+   Registers* const regs = this->current;                                     \
+   address = PREG;                                                            \
+   if (address != expected) return true;                                      \
+   SETP(address + 2);                                                         \
+   expected = address + 2;                                                    \
+   decoded = &code [count++];                                                 \
+}
+
+// We stop early if the translated blocks become stale, or on an event for
+// run's caller, e.g. a write to the I/O page, just as the interpreter would.
+//
+#define DISPATCH {                                                            \
+   if ((count == number) || loadRelaxed (&this->blocksStale) ||               \
+       (this->pendingEvent != completed)) return true;                        \
+   FETCH;                                                                     \
+   GOTO_NEXT;                                                                 \
+}
+
+   FETCH;
+   GOTO_NEXT;
+
+#define LABEL(opcode, word, suffix)                                           \
+op_##opcode##suffix:                                                          \
+   if (!this->handler <opcode, word> (*decoded, address)) return false;       \
+   DISPATCH;
+
+#define LABEL_MEM(opcode)  LABEL(opcode, true, _w) LABEL(opcode, false, _b)
+#define LABEL_LIT(opcode)  LABEL(opcode, true, _w)
+
+   HANDLER_LIST (LABEL_MEM, LABEL_LIT)
+
+#undef LABEL
+#undef LABEL_MEM
+#undef LABEL_LIT
+
+#ifndef L16E_COMPUTED_GOTO
+dispatchSwitch:
+   switch (decoded->handler) {
+#define CASE_MEM(opcode)  case 2*opcode:   goto op_##opcode##_w;                \
+                          case 2*opcode+1: goto op_##opcode##_b;
+#define CASE_LIT(opcode)  case 2*opcode:   goto op_##opcode##_w;
+      HANDLER_LIST (CASE_MEM, CASE_LIT)
+#undef CASE_MEM
+#undef CASE_LIT
+   }
+#endif
+
+#undef FETCH
+#undef DISPATCH
+#undef GOTO_NEXT
+
+   return true;   // not reached
+}
+
+#undef OPCODE_MAP
+#undef HANDLER_LIST
+
+}   // end L16E namespace
+
 // end
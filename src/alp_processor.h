@@ -12,11 +12,20 @@
 #ifndef L16E_ALP_PROCESSOR_H
 #define L16E_ALP_PROCESSOR_H
 
+#include <stdint.h>
 #include <string.h>
+#include <mutex>
+#include <string>
+#include <vector>
 #include "data_bus.h"
 
 namespace L16E {
 
+class Diagnostics;
+class JIT_Compiler;
+class IoRequestQueue;
+class TraceBuffer;
+
 class ALP_Processor : public DataBus::ActiveDevice
 {
 public:
@@ -25,14 +34,114 @@ public:
       alp2       // not implemented yet
    };
 
+   enum Engines {
+      interpreter,       // one instruction at a time - the reference
+      blockTranslator,   // straight-line runs of instructions at a time
+      nativeCompiler     // as blockTranslator, plus native code for hot blocks
+   };
+
+   // The registers are cache line aligned, which plain new does not honour
+   // before C++17.
+   //
+   static void* operator new (size_t size);
+   static void operator delete (void* p);
+
    explicit ALP_Processor(const int slot,           // 1 for primary etc.
                           const ALPKinds alpKind,   // 1 or 2
                           DataBus* const dataBus);
    ~ALP_Processor();
 
+   bool initialise ();
    void requestInterrupt ();
    bool execute();   // fetch and execute one instruction
 
+   // Fetch and execute a translated block of upto maxInstructions, i.e. up to
+   // and including the next jump. The number executed is returned in count.
+   //
+   bool executeBlock(const int maxInstructions, int& count);
+
+   // Fetch and execute upto maxInstructions using the selected engine.
+   // Returns early on a break point, an interrupt request, an I/O page write
+   // or an undefined instruction.
+   //
+   RunStatus run (const int maxInstructions, int& count);
+   void getIdleWait (int& fd, int& loopLength) const;
+
+   // Break points are checked, by run, when diagnostics is specified.
+   //
+   void setDiagnostics (Diagnostics* diagnostics);
+
+   void setEngine (const Engines engine);
+   Engines getEngine () const;
+
+   // When set, run also returns idle for any tight loop that does nothing
+   // but wait (e.g. for the clock interrupt), not just serial polling loops.
+   // Ignored while running on own host thread, see setIoRequestQueue.
+   //
+   void setFastForward (const bool fastForward);
+
+   // When the processor runs on its own host thread, all data bus accesses
+   // other than to host memory pages go via the queue, which is serviced by
+   // the main thread. Set to nullptr when run on the main thread.
+   //
+   void setIoRequestQueue (IoRequestQueue* queue);
+
+   // Opcode histogram - counts of executed instructions, indexed by the
+   // instruction ms byte. While enabled, run executes one instruction at a
+   // time. getOpcodeCounts returns nullptr when disabled. Enabling clears
+   // the counts.
+   //
+   void setOpcodeCounting (const bool enable);
+   const uint64_t* getOpcodeCounts () const;
+
+   // Execution counts per instruction address, indexed by word address, i.e.
+   // address / 2, as per the opcode histogram.
+   //
+   enum { numberAddressCounts = 32768 };
+   void setAddressCounting (const bool enable);
+   const uint64_t* getAddressCounts () const;
+
+   // Execution trace - records each instruction executed into a ring buffer
+   // of capacity records mapped onto filename. Instructions are executed one
+   // at a time while tracing.
+   //
+   bool startTrace (const std::string filename, const int capacity);
+   void stopTrace ();
+   bool isTracing () const;
+
+   // Watch points are set on the data bus. When an operand read or write
+   // hits one, run completes the instruction and returns breakPoint. The
+   // hit is available until the next run.
+   //
+   struct WatchHit {
+      Int16 address;         // of the instruction
+      Int16 location;        // watched address accessed
+      Int16 value;           // read or written
+      int kind;              // DataBus::watchRead or DataBus::watchWrite
+      unsigned int level;
+   };
+
+   bool getWatchHit (WatchHit& hit) const;   // returns false if none
+
+   // Discard predecoded instructions that may no longer be valid.
+   //
+   void memoryModified (const Int16 addr);
+   void mappingModified ();
+   void allMemoryModified ();
+   void breakPointsModified ();
+
+   // True if the next instruction is at a break point, and its condition
+   // and count, if any, are satisfied.
+   //
+   bool isAtBreakPoint () const;
+
+   // When set (-1 for none), run returns atStopAddress when the next
+   // instruction, other than the first, is at address. Unlike a break point,
+   // the block engines remain in use - blocks end before the stop address.
+   //
+   void setStopAddress (const int address);
+   bool isAtStopAddress () const;
+
    unsigned int getLevel() const;
    void dumpRegisters(const unsigned int level) const;
    void dumpRegisters() const;
@@ -43,23 +152,244 @@ public:
    Int16 getWord(const Int16 addr) const;
    void setWord(const Int16 addr, const Int16  value);
 
+   // The state is the registers of all levels, the current level and any
+   // pending interrupt. Restoring discards all predecoded instructions.
+   //
+   void saveState (std::vector<UInt8>& state) const;
+   bool restoreState (const UInt8* state, const size_t size);
+
 private:
    const int slot;
    const ALPKinds alpKind;
    const unsigned int numberLevels;
 
+   // The registers of one level, together in one cache line.
+   //
+   struct alignas(64) Registers {
+      Int16 p;
+      Int16 a;
+      Int16 r;
+      Int16 s;
+      Int16 t;
+      bool c;                // carry flag
+      bool v;                // overflow flag
+      bool k;                // inhibits interrupts
+      int triggerKind;       // see TriggerKinds
+      int triggerA;          // deferred trigger operands
+      int triggerB;
+   };
+
+   // Saved registers, with the triggers evaluated.
+   //
+   struct SavedLevel {
+      Int16 p;
+      Int16 a;
+      Int16 r;
+      Int16 s;
+      Int16 t;
+      UInt8 c;
+      UInt8 v;
+      UInt8 k;
+      UInt8 spare;
+   };
+
+   struct SavedState {
+      SavedLevel levels [4];
+      UInt8 level;
+      UInt8 interruptRequested;
+      UInt8 spare [2];
+   };
+
+   void setLevel (const unsigned int level);   // sets current as well
+
    unsigned int level;       // 0 .. 3 ALP1,  0 .. 1  ALP2/3
-   Int16 preg [4];
-   Int16 areg [4];
-   Int16 rreg [4];
-   Int16 sreg [4];
-   Int16 treg [4];
-   bool cTrigger [4];        // carry flag
-   bool vTrigger [4];        // overflow flag
-   bool kFlag [4];           // inhibits interrupts
+   Registers registers [4];
+   Registers* current;       // registers of the current level
    bool interruptRequested;  // indicates an interrupt is pending.
 
+   // The C and V triggers are evaluated lazily. Arithmetic instructions just
+   // save the kind of operation and the operands, and the triggers are only
+   // evaluated when actually read.
+   //
+   enum TriggerKinds {
+      evaluatedTriggers,     // cTrigger and vTrigger hold the values
+      compareTriggers,       // C: a == b,     V: a < b
+      arithmeticTriggers     // C: a bit 16,   V: a out of range, a = result
+   };
+
+   static bool getCTrigger (const Registers* regs);
+   static bool getVTrigger (const Registers* regs);
+   static void setTriggers (Registers* regs, const bool c, const bool v);
+
    bool debug;
+   uint64_t* opcodeCounts;   // [256] or nullptr
+   uint64_t* addressCounts;  // [numberAddressCounts] or nullptr
+   TraceBuffer* trace;       // or nullptr
+   Engines engine;
+   Diagnostics* diagnostics;
+   bool hasStopAddress;
+   Int16 stopAddress;
+   mutable RunStatus pendingEvent;   // completed means none
+
+   // Set by the slow path on a watch point hit, the first in each run.
+   //
+   void noteWatchHit (const Int16 addr, const int kind, const Int16 value) const;
+   mutable bool watchHitPending;
+   mutable WatchHit watchHit;
+
+   // Predecoded instruction cache - one entry per word address.
+   // An entry is not valid until decoded, and is invalidated by a memory
+   // write or a memory mapping change.
+   //
+   struct Decoded {
+      const void* target;    // handler label, computed goto dispatch only
+      Int16 instruction;     // as fetched
+      Int16 offset;          // signed word, byte or jump offset
+      Int16 handler;         // handler key, see handlerMap
+      UInt8 lsiByte;         // literal value or shift/special qualifier
+      bool isWord;           // as opposed to byte or, for jumps, indirect
+      bool isValid;
+   };
+
+   enum CacheConstants {
+      numberCacheEntries = 32768
+   };
+
+   void decode (const Int16 instruction, Decoded& decoded) const;
+   void decodeEntry (const Int16 address, Decoded& decoded) const;
+   void invalidateCache (const int first, const int last);  // cache indices
+   void invalidateEntry (const int index);                  // and any block
+   bool prepareToExecute ();  // sanity checks and interrupt handling
+   bool traceExecute (const Decoded* decoded, const Int16 address);
+   bool testBreakCondition () const;
+
+   // Executes upto number instructions from code, returning the number
+   // actually executed in count.
+   //
+   bool dispatch (const Decoded* code, const int number, int& count);
+
+   // One handler per op code, or op code pair for memory reference
+   // instructions, and for memory reference instructions, one variant each
+   // for word and byte (or for jumps, direct and indirect) addressing.
+   // All specialised in alp_processor.cpp
+   //
+   template <int opcode, bool isWord>
+   bool handler (const Decoded& decoded, const Int16 address);
+
+   template <int opcode>
+   bool shiftOrSpecial (const Decoded& decoded, const Int16 address);
+
+   // Both indexed by msiByte*2 + lsi byte flag.
+   //
+   static const Int16 handlerMap [512];           // handler key
+   static const void* const* dispatchTable;       // handler label
+
+   // Page table - host memory for each 4K byte page as seen by this processor,
+   // or nullptr for pages accessed via the data bus, e.g. the I/O page.
+   // Rebuilt when our memory mapping is modified, see mappingModified.
+   //
+   struct Page {
+      UInt8* read;
+      UInt8* write;
+   };
+
+   void buildPageTable (Page table [16]) const;
+   void applyMapping ();
+
+   template <bool isWord> Int16 readMemory (const Int16 addr) const;
+   template <bool isWord> void writeMemory (const Int16 addr, const Int16 value);
+   Int16 fetchWord (const Int16 addr) const;
+   template <bool isWord> Int16 trappedRead (const Int16 addr) const;
+
+   Int16 busGetWord (const Int16 addr) const;
+   UInt8 busGetByte (const Int16 addr) const;
+   void busSetWord (const Int16 addr, const Int16 value);
+   void busSetByte (const Int16 addr, const UInt8 value);
+   bool busIsIdlePoll (const Int16 addr, int& fd) const;
+
+   IoRequestQueue* ioQueue;  // only when running on own host thread
+
+   Page pageTable [16];    // indexed by address ms nibble
+
+   // Posted by mappingModified, applied by applyMapping.
+   //
+   std::mutex mappingLock;
+   Page postedPageTable [16];
+   bool mappingPosted;
+
+   // Set by the read slow path, i.e. typically an I/O page register read.
+   //
+   mutable bool slowRead;
+   mutable Int16 slowReadAddress;
+
+   // Idle polling loop detection. A guest waiting for input spins on a
+   // serial status register. We treat a short loop as idle when successive
+   // reads of the same, not ready, status register occur at the same point,
+   // the same number of instructions apart, with the processor state unchanged
+   // and nothing written to memory in between. Executing further iterations
+   // then changes nothing, other than the passing of time.
+   // With fast forward, the loop points are backward jumps instead, so that
+   // loops waiting for an interrupt are also detected.
+   //
+   enum IdleConstants {
+      maximumIdleLoopLength = 16,    // instructions per iteration
+      idleLoopThreshold = 4          // identical iterations before idle
+   };
+
+   struct IdleLoop {
+      Int16 address;                 // status register
+      int since;                     // instructions since previous read
+      int length;                    // instructions per iteration
+      int matches;                   // consecutive identical iterations
+      int busWrites;                 // as at previous read
+      unsigned int level;
+      Registers registers;           // as at previous read
+      int fd;                        // to wait on, or -1
+      int pollFd;                    // for the current iteration
+      bool busy;                     // current iteration read a non-idle register
+   };
+
+   bool checkIdleLoop (const Int16 address, const bool isIdle);
+   bool fastForward;
+   IdleLoop idleLoop;
+   int busWrites;                 // count of memory modifications
+
+   Decoded* decodeCache;
+
+   // Block translation - threaded code for straight-line runs of instructions.
+   //
+   enum BlockConstants {
+      maximumBlockLength = 32,
+      nativeThreshold = 20       // block entries before native compilation
+   };
+
+   // Native code returns the number of instructions executed, and leaves P
+   // set to the next instruction.
+   //
+   typedef int (*NativeCode) (ALP_Processor* processor);
+
+   struct Block {
+      Int16 start;
+      int length;
+      Decoded code [maximumBlockLength];
+
+      int entries;           // number of times executed
+      NativeCode native;     // nullptr until/unless compiled
+      int nativeLength;      // number of instructions compiled, may be < length
+      unsigned int nativeLevel;
+   };
+
+   Block* translate (const Int16 start);
+   void flushBlocks ();
+
+   Block** blockCache;       // indexed as per decodeCache, by start address
+   bool* blockCoverage;      // true when word is part of any block
+   std::vector<int> blockStarts;
+   bool blocksStale;         // a translated instruction has been modified
+
+   JIT_Compiler* jit;        // only when using the native compiler engine
+
+   friend class JIT_Compiler;
 };
 
 }
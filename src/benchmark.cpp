@@ -0,0 +1,324 @@
+/* benchmark.cpp
+ *
+ * Emulator core benchmark, part of the Locus 16 Emulator.
+ *
+ * SPDX-FileCopyrightText: 2021-2025  Andrew C. Starritt
+ * SPDX-License-Identifier: LGPL-3.0-only
+ *
+ * Contact details:
+ * andrew.starritt@gmail.com
+ */
+
+// Measures emulated instructions per second for each class of instruction,
+// for each execution engine, and the raw data bus word access rate for RAM,
+// ROM and I/O addresses. The crate is built in code, i.e. there is no
+// configuration file, ROM file, terminal or tape.
+//
+// Output is CSV, one line per measurement:
+//   benchmark,engine,operations,seconds,operations_per_second
+//
+// usage: locus16_bench [number]   - number of operations per measurement
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "locus16_common.h"
+#include "alp_processor.h"
+#include "clock.h"
+#include "data_bus.h"
+#include "jit_compiler.h"
+#include "memory.h"
+#include "rom.h"
+
+using namespace L16E;
+
+// Where things go in emulated memory.
+//
+static const Int16 codeStart = Int16 (0xA000);
+static const Int16 dataStart = Int16 (0xB000);
+static const Int16 romAddress = Int16 (0x8000);
+static const Int16 ioAddress = Int16 (0x7C02);      // clock interval register
+static const Int16 level1Registers = Int16 (0x7F10);
+
+// Instructions per loop body, excluding the loop jump. Small enough for the
+// loop jump to reach back to the start.
+//
+static const int bodyLength = 100;
+
+// Index register encodings.
+//
+enum Index { P = 0, R = 1, S = 2, T = 3 };
+
+//------------------------------------------------------------------------------
+// Memory reference instructions, e.g. SETA offset,R. The op is the ms nibble
+// for ops 8 to 11 (SUB, AND, NEQ, IOR) and 13 (MLT), otherwise the ms three
+// bits, with register A, i.e. SET = 0, STR = 1, ADD = 2, CMP = 3.
+//
+static Int16 memoryWord (const int op, const Index index, const int offset)
+{
+   const int base = (op < 4) ? (op << 13) : (op << 12);
+   return Int16 (base | (index << 9) | (offset & 0xFE));
+}
+
+static Int16 memoryByte (const int op, const Index index, const int offset)
+{
+   const int base = (op < 4) ? (op << 13) : (op << 12);
+   return Int16 (base | (index << 9) | ((offset & 0x7F) << 1) | 1);
+}
+
+//------------------------------------------------------------------------------
+//
+static double now ()
+{
+   struct timespec ts;
+   clock_gettime (CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + 1.0e-9 * ts.tv_nsec;
+}
+
+//------------------------------------------------------------------------------
+//
+static void report (const char* benchmark, const char* engine,
+                    const int64_t operations, const double seconds)
+{
+   printf ("%s,%s,%ld,%.6f,%.0f\n", benchmark, engine, long (operations),
+           seconds, seconds > 0.0 ? operations / seconds : 0.0);
+   fflush (stdout);
+}
+
+//------------------------------------------------------------------------------
+// The crate: memory mapper, RAM, ROM (never loaded - all ones), a clock for
+// I/O accesses (never started) and a primary ALP.
+//
+class Crate {
+public:
+   Crate () :
+      dataBus (new DataBus()),
+      mapper (new MemoryMapper (dataBus)),
+      memory (new Memory (74, mapper, dataBus)),
+      rom (new ROM ("", dataBus)),
+      clock (new Clock (dataBus)),
+      processor (new ALP_Processor (1, ALP_Processor::alp1, dataBus))
+   {
+      this->memory->initialise();
+      this->processor->initialise();
+   }
+
+   ~Crate ()
+   {
+      const int n = this->dataBus->deviceCount();
+      for (int d = 0; d < n; d++) {
+         delete this->dataBus->getDevice (d);
+      }
+      delete this->dataBus;
+   }
+
+   DataBus* const dataBus;
+   MemoryMapper* const mapper;
+   Memory* const memory;
+   ROM* const rom;
+   Clock* const clock;
+   ALP_Processor* const processor;
+};
+
+//------------------------------------------------------------------------------
+// An instruction class benchmark. Each loop body instruction is given by
+// instruction (k), and any data by setup.
+//
+struct InstructionBenchmark {
+   const char* name;
+   Int16 (*instruction) (const int k);
+   void (*setup) (DataBus* dataBus);
+};
+
+static void noSetup (DataBus*) { }
+
+// Indirect jumps via a table of next instruction addresses at R.
+//
+static void jumpTable (DataBus* dataBus)
+{
+   for (int k = 0; k < bodyLength; k++) {
+      dataBus->setWord (dataStart + 2*k, codeStart + 2*(k + 1));
+   }
+}
+
+static Int16 setWord (const int)  { return memoryWord (0, R, 0); }
+static Int16 setByte (const int)  { return memoryByte (0, R, 1); }
+static Int16 strWord (const int)  { return memoryWord (1, R, 2); }
+static Int16 strByte (const int)  { return memoryByte (1, R, 3); }
+static Int16 addWord (const int)  { return memoryWord (2, R, 0); }
+static Int16 subWord (const int)  { return memoryWord (8, R, 0); }
+static Int16 cmpWord (const int)  { return memoryWord (3, R, 0); }
+static Int16 andWord (const int)  { return memoryWord (9, R, 0); }
+static Int16 neqWord (const int)  { return memoryWord (10, R, 0); }
+static Int16 iorWord (const int)  { return memoryWord (11, R, 0); }
+static Int16 mltWord (const int)  { return memoryWord (13, R, 0) | 0x0800; }
+static Int16 setLiteral (const int k)  { return Int16 (0xE000 | (k & 0xFF)); }
+static Int16 addLiteral (const int)  { return Int16 (0xE101); }
+static Int16 jumpDirect (const int)  { return Int16 (0xC000); }      // J .+2
+static Int16 jumpSubDirect (const int)  { return Int16 (0xC800); }   // JS .+2
+static Int16 jumpCondition (const int)  { return Int16 (0xD400); }   // JCS .+2
+static Int16 jumpIndirect (const int k)  { return Int16 (0xC200 | (2*k) | 1); }  // J 2k,R,I
+static Int16 shiftLeft (const int)  { return Int16 (0xE741); }       // SHLA 1,L
+static Int16 shiftRight (const int)  { return Int16 (0xE762); }      // SHRA 2,L
+static Int16 setLevel (const int)  { return Int16 (0xFF01); }        // SETL 1
+
+static const InstructionBenchmark instructionBenchmarks [] = {
+   { "set_word",        setWord,       noSetup   },
+   { "set_byte",        setByte,       noSetup   },
+   { "str_word",        strWord,       noSetup   },
+   { "str_byte",        strByte,       noSetup   },
+   { "add",             addWord,       noSetup   },
+   { "sub",             subWord,       noSetup   },
+   { "cmp",             cmpWord,       noSetup   },
+   { "and",             andWord,       noSetup   },
+   { "neq",             neqWord,       noSetup   },
+   { "ior",             iorWord,       noSetup   },
+   { "mlt",             mltWord,       noSetup   },
+   { "set_literal",     setLiteral,    noSetup   },
+   { "add_literal",     addLiteral,    noSetup   },
+   { "j_direct",        jumpDirect,    noSetup   },
+   { "js_direct",       jumpSubDirect, noSetup   },
+   { "jcc_direct",      jumpCondition, noSetup   },
+   { "j_indirect",      jumpIndirect,  jumpTable },
+   { "shift_left",      shiftLeft,     noSetup   },
+   { "shift_right",     shiftRight,    noSetup   },
+   { "setl",            setLevel,      noSetup   }
+};
+
+//------------------------------------------------------------------------------
+// Returns false if the processor fails, i.e. the benchmark code is bad.
+//
+static bool runInstructionBenchmark (const InstructionBenchmark& benchmark,
+                                     const ALP_Processor::Engines engine,
+                                     const char* engineName,
+                                     const int64_t number)
+{
+   Crate crate;
+   DataBus* const dataBus = crate.dataBus;
+   ALP_Processor* const processor = crate.processor;
+
+   // The loop body, then a jump back to the start.
+   //
+   for (int k = 0; k < bodyLength; k++) {
+      dataBus->setWord (codeStart + 2*k, benchmark.instruction (k));
+   }
+   const int back = 2*bodyLength + 2;
+   dataBus->setWord (codeStart + 2*bodyLength, Int16 (0xC100 | back));  // J .-back+2
+   benchmark.setup (dataBus);
+
+   // Level 1 registers: P, A, R, S, T
+   //
+   dataBus->setWord (level1Registers + 0x02, codeStart);
+   dataBus->setWord (level1Registers + 0x04, 3);
+   dataBus->setWord (level1Registers + 0x06, dataStart);
+   dataBus->setWord (level1Registers + 0x08, dataStart);
+   dataBus->setWord (level1Registers + 0x0A, dataStart);
+   dataBus->setWord (dataStart, 5);
+
+   processor->setEngine (engine);
+
+   const double start = now();
+   int64_t total = 0;
+   while (total < number) {
+      int count = 0;
+      const DataBus::ActiveDevice::RunStatus status =
+            processor->run (int (MIN (number - total, int64_t (10000))), count);
+      total += count;
+      if (status == DataBus::ActiveDevice::failed) {
+         fprintf (stderr, "%s,%s: processor failed\n", benchmark.name, engineName);
+         return false;
+      }
+   }
+   report (benchmark.name, engineName, total, now() - start);
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+static void runDataBusBenchmarks (const int64_t number)
+{
+   Crate crate;
+   DataBus* const dataBus = crate.dataBus;
+
+   struct Target {
+      const char* name;
+      Int16 addr;
+      Int16 mask;       // within the page/register set
+   };
+
+   static const Target targets [3] = {
+      { "ram", dataStart,  Int16 (0x0FFE) },
+      { "rom", romAddress, Int16 (0x0FFE) },
+      { "io",  ioAddress,  Int16 (0x0000) }
+   };
+
+   for (int t = 0; t < 3; t++) {
+      const Target& target = targets [t];
+      char name [40];
+
+      volatile int sum = 0;
+      int local = 0;
+      double start = now();
+      for (int64_t j = 0; j < number; j++) {
+         local += dataBus->getWord (target.addr + (Int16 (2*j) & target.mask));
+      }
+      sum = local;
+      snprintf (name, sizeof (name), "bus_get_word_%s", target.name);
+      report (name, "-", number, now() - start);
+
+      start = now();
+      for (int64_t j = 0; j < number; j++) {
+         dataBus->setWord (target.addr + (Int16 (2*j) & target.mask), Int16 (j | 1));
+      }
+      snprintf (name, sizeof (name), "bus_set_word_%s", target.name);
+      report (name, "-", number, now() - start);
+      (void) sum;
+   }
+}
+
+//------------------------------------------------------------------------------
+//
+int main (int argc, char** argv)
+{
+   int64_t number = 10000000;
+   if (argc >= 2) {
+      long temp;
+      if ((sscanf (argv [1], "%ld", &temp) != 1) || (temp < 1)) {
+         fprintf (stderr, "usage: %s [number]\n", argv [0]);
+         return 1;
+      }
+      number = temp;
+   }
+
+   struct EngineSpec {
+      ALP_Processor::Engines engine;
+      const char* name;
+   };
+
+   static const EngineSpec engines [3] = {
+      { ALP_Processor::interpreter,     "interpreter" },
+      { ALP_Processor::blockTranslator, "block"       },
+      { ALP_Processor::nativeCompiler,  "jit"         }
+   };
+
+   const int numberEngines = JIT_Compiler::isAvailable() ? 3 : 2;
+
+   bool status = true;
+   printf ("benchmark,engine,operations,seconds,operations_per_second\n");
+   for (int e = 0; e < numberEngines; e++) {
+      for (int b = 0; b < ARRAY_LENGTH (instructionBenchmarks); b++) {
+         status &= runInstructionBenchmark (instructionBenchmarks [b],
+                                            engines [e].engine, engines [e].name,
+                                            number);
+      }
+   }
+
+   runDataBusBenchmarks (number);
+
+   return status ? 0 : 2;
+}
+
+// end
@@ -0,0 +1,288 @@
+/* break_condition.cpp
+ *
+ * This file is part of the Locus 16 Emulator application.
+ *
+ * SPDX-FileCopyrightText: 2021-2025  Andrew C. Starritt
+ * SPDX-License-Identifier: LGPL-3.0-only
+ *
+ * Contact details:
+ * andrew.starritt@gmail.com
+ */
+
+#include "break_condition.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+using namespace L16E;
+
+//==============================================================================
+// Parser - recursive descent, one function per precedence level, emitting
+// the program as it goes.
+//==============================================================================
+//
+class BreakCondition::Parser {
+public:
+   explicit Parser (const std::string& textIn, std::vector<Instruction>& programIn) :
+      text (textIn),
+      program (programIn)
+   {
+      this->position = 0;
+      this->depth = 0;
+      this->maximum = 0;
+   }
+
+   bool parse (std::string& error)
+   {
+      this->error = "";
+      const bool okay = this->parseOr () && this->expectEnd ();
+      error = this->error;
+      return okay;
+   }
+
+private:
+   void skipSpace ()
+   {
+      while ((this->position < this->text.size ()) &&
+             isspace (int (this->text [this->position]))) this->position++;
+   }
+
+   // Consumes the symbol if next, but not if it is the start of a longer
+   // symbol that is listed in notBefore, e.g. & when && is next.
+   //
+   bool accept (const char* symbol, const char notBefore = '\0')
+   {
+      this->skipSpace ();
+      const size_t n = strlen (symbol);
+      if (this->text.compare (this->position, n, symbol) != 0) return false;
+      if ((notBefore != '\0') && (this->position + n < this->text.size ()) &&
+          (this->text [this->position + n] == notBefore)) return false;
+      this->position += n;
+      return true;
+   }
+
+   bool fail (const char* reason)
+   {
+      if (this->error.empty ()) {
+         this->error = std::string (reason) + " at column " +
+                       std::to_string (this->position + 1);
+      }
+      return false;
+   }
+
+   // Emits the instruction, tracking the evaluation stack depth.
+   //
+   bool emit (const int code, const int operand, const int pushes)
+   {
+      this->program.push_back ({ code, operand });
+      this->depth += pushes;
+      if (this->depth > this->maximum) this->maximum = this->depth;
+      if (this->maximum > maximumDepth) return this->fail ("too complex");
+      return true;
+   }
+
+   bool expectEnd ()
+   {
+      this->skipSpace ();
+      if (this->position < this->text.size ()) return this->fail ("unexpected text");
+      return true;
+   }
+
+   bool parseOr ()
+   {
+      if (!this->parseAnd ()) return false;
+      while (this->accept ("||")) {
+         if (!this->parseAnd ()) return false;
+         if (!this->emit (opLogicalOr, 0, -1)) return false;
+      }
+      return true;
+   }
+
+   bool parseAnd ()
+   {
+      if (!this->parseComparison ()) return false;
+      while (this->accept ("&&")) {
+         if (!this->parseComparison ()) return false;
+         if (!this->emit (opLogicalAnd, 0, -1)) return false;
+      }
+      return true;
+   }
+
+   bool parseComparison ()
+   {
+      if (!this->parseSum ()) return false;
+
+      // Longest first.
+      //
+      int code;
+      if      (this->accept ("==")) code = opEqual;
+      else if (this->accept ("!=")) code = opNotEqual;
+      else if (this->accept ("<=")) code = opLessEqual;
+      else if (this->accept (">=")) code = opGreaterEqual;
+      else if (this->accept ("<"))  code = opLess;
+      else if (this->accept (">"))  code = opGreater;
+      else return true;
+
+      if (!this->parseSum ()) return false;
+      return this->emit (code, 0, -1);
+   }
+
+   bool parseSum ()
+   {
+      if (!this->parseUnary ()) return false;
+      while (true) {
+         int code;
+         if      (this->accept ("+"))      code = opAdd;
+         else if (this->accept ("-"))      code = opSubtract;
+         else if (this->accept ("&", '&')) code = opAnd;
+         else return true;
+
+         if (!this->parseUnary ()) return false;
+         if (!this->emit (code, 0, -1)) return false;
+      }
+   }
+
+   bool parseUnary ()
+   {
+      if (this->accept ("!", '=')) {
+         return this->parseUnary () && this->emit (opNot, 0, 0);
+      }
+      if (this->accept ("-")) {
+         return this->parseUnary () && this->emit (opNegate, 0, 0);
+      }
+      return this->parsePrimary ();
+   }
+
+   bool parsePrimary ()
+   {
+      if (this->accept ("(")) {
+         if (!this->parseOr ()) return false;
+         if (!this->accept (")")) return this->fail ("missing )");
+         return true;
+      }
+
+      this->skipSpace ();
+      const size_t start = this->position;
+      while ((this->position < this->text.size ()) &&
+             isalnum (int (this->text [this->position]))) this->position++;
+      const std::string word = this->text.substr (start, this->position - start);
+
+      if (word.empty ()) return this->fail ("operand expected");
+
+      if (isdigit (int (word [0]))) {
+         const bool isHex = (word.size () > 2) && (word [0] == '0') &&
+                            (tolower (word [1]) == 'x');
+         char* end;
+         const long value = isHex ? strtol (word.c_str () + 2, &end, 16) :
+                                    strtol (word.c_str (), &end, 10);
+         if ((*end != '\0') || (value > 65535)) {
+            this->position = start;
+            return this->fail ("invalid number");
+         }
+
+         // Numbers are 16 bit values, e.g. 0xFFFF and 65535 are -1, like the
+         // registers.
+         //
+         const int operand = int (Int16 (value));
+         return this->emit (opConstant, operand, +1);
+      }
+
+      static const char* const names [] = {
+         "A", "R", "S", "T", "P", "LEVEL", "C", "V", "K"
+      };
+
+      for (int j = 0; j < ARRAY_LENGTH (names); j++) {
+         if (strcasecmp (word.c_str (), names [j]) == 0) {
+            return this->emit (opRegister, j, +1);
+         }
+      }
+
+      this->position = start;
+      return this->fail ("unknown name");
+   }
+
+   const std::string& text;
+   std::vector<Instruction>& program;
+   std::string error;
+   size_t position;
+   int depth;
+   int maximum;
+};
+
+
+//==============================================================================
+// BreakCondition
+//==============================================================================
+//
+// static
+BreakCondition* BreakCondition::compile (const std::string text, std::string& error)
+{
+   BreakCondition* result = new BreakCondition (text);
+   Parser parser (result->text, result->program);
+   if (!parser.parse (error)) {
+      delete result;
+      result = nullptr;
+   }
+   return result;
+}
+
+//------------------------------------------------------------------------------
+//
+BreakCondition::BreakCondition (const std::string textIn) :
+   text (textIn)
+{
+}
+
+//------------------------------------------------------------------------------
+//
+BreakCondition::~BreakCondition () { }
+
+//------------------------------------------------------------------------------
+//
+const std::string& BreakCondition::getText () const
+{
+   return this->text;
+}
+
+//------------------------------------------------------------------------------
+// The program has been checked by compile, so no checks here.
+//
+bool BreakCondition::evaluate (const State& state) const
+{
+   const int registers [] = {
+      state.a, state.r, state.s, state.t, state.p,
+      int (state.level), state.c, state.v, state.k
+   };
+
+   int stack [maximumDepth];
+   int top = -1;
+
+   const Instruction* const program = this->program.data ();
+   const int length = int (this->program.size ());
+
+   for (int j = 0; j < length; j++) {
+      const int operand = program [j].operand;
+      switch (program [j].code) {
+         case opRegister:     stack [++top] = registers [operand];      break;
+         case opConstant:     stack [++top] = operand;                  break;
+         case opNot:          stack [top] = !stack [top];               break;
+         case opNegate:       stack [top] = -stack [top];               break;
+         case opAdd:          top--; stack [top] = stack [top] + stack [top + 1];  break;
+         case opSubtract:     top--; stack [top] = stack [top] - stack [top + 1];  break;
+         case opAnd:          top--; stack [top] = stack [top] & stack [top + 1];  break;
+         case opEqual:        top--; stack [top] = stack [top] == stack [top + 1]; break;
+         case opNotEqual:     top--; stack [top] = stack [top] != stack [top + 1]; break;
+         case opLess:         top--; stack [top] = stack [top] <  stack [top + 1]; break;
+         case opLessEqual:    top--; stack [top] = stack [top] <= stack [top + 1]; break;
+         case opGreater:      top--; stack [top] = stack [top] >  stack [top + 1]; break;
+         case opGreaterEqual: top--; stack [top] = stack [top] >= stack [top + 1]; break;
+         case opLogicalAnd:   top--; stack [top] = stack [top] && stack [top + 1]; break;
+         case opLogicalOr:    top--; stack [top] = stack [top] || stack [top + 1]; break;
+      }
+   }
+
+   return stack [0] != 0;
+}
+
+// end
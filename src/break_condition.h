@@ -0,0 +1,98 @@
+/* break_condition.h
+ *
+ * This file is part of the Locus 16 Emulator application.
+ *
+ * SPDX-FileCopyrightText: 2021-2025  Andrew C. Starritt
+ * SPDX-License-Identifier: LGPL-3.0-only
+ *
+ * Contact details:
+ * andrew.starritt@gmail.com
+ */
+
+#ifndef L16E_BREAK_CONDITION_H
+#define L16E_BREAK_CONDITION_H
+
+#include <string>
+#include <vector>
+#include "locus16_common.h"
+
+namespace L16E {
+
+// A break point condition, e.g. "A==0 && level==1", compiled once into a
+// small stack machine program, so that evaluating it at each break point hit
+// involves no parsing.
+//
+// Operands are the registers A, R, S, T and P (signed 16 bit), LEVEL, and the
+// C, V and K flags (0 or 1), and decimal or 0x hex numbers upto 65535 (0xFFFF),
+// taken as 16 bit values, e.g. 40000 is -25536 and 0xFFFF is -1. Names are
+// case insensitive. Operators, highest precedence first, are: unary ! and -,
+// binary + - &, comparisons == != < <= > >=, && and ||, and parentheses.
+//
+class BreakCondition {
+public:
+   // The processor state a condition is evaluated against.
+   //
+   struct State {
+      Int16 p;
+      Int16 a;
+      Int16 r;
+      Int16 s;
+      Int16 t;
+      unsigned int level;
+      bool c;
+      bool v;
+      bool k;
+   };
+
+   // Returns nullptr if text is not a valid condition, with the reason in
+   // error.
+   //
+   static BreakCondition* compile (const std::string text, std::string& error);
+   ~BreakCondition ();
+
+   bool evaluate (const State& state) const;
+   const std::string& getText () const;
+
+private:
+   enum OpCodes {
+      opRegister,            // push the operand register, see Registers
+      opConstant,            // push the operand
+      opNot,
+      opNegate,
+      opAdd,
+      opSubtract,
+      opAnd,
+      opEqual,
+      opNotEqual,
+      opLess,
+      opLessEqual,
+      opGreater,
+      opGreaterEqual,
+      opLogicalAnd,
+      opLogicalOr
+   };
+
+   enum Registers {
+      regA, regR, regS, regT, regP, regLevel, regC, regV, regK
+   };
+
+   enum Constants {
+      maximumDepth = 32      // evaluation stack
+   };
+
+   struct Instruction {
+      int code;
+      int operand;
+   };
+
+   class Parser;
+
+   explicit BreakCondition (const std::string text);
+
+   const std::string text;
+   std::vector<Instruction> program;
+};
+
+}
+
+#endif // L16E_BREAK_CONDITION_H
@@ -10,6 +10,7 @@
  */
 
 #include "clock.h"
+#include <string.h>
 
 using namespace L16E;
 
@@ -32,14 +33,17 @@ Clock::~Clock() { }   // place holder
 //------------------------------------------------------------------------------
 //
 void Clock::executeCycle()
+{
+   this->executeCycles (1);
+}
+
+//------------------------------------------------------------------------------
+//
+void Clock::executeCycles(const int number)
 {
    if (this->isRunning) {
-      // A typlical ALP instruction is 2.25 uSec
-      // If more than one active device, we should adjust this.
-      // Note: it is far from linear, due to bus contention
-      //
-      double duration = (3.0 * 2.25) / (this->numberActiveDevices + 2.0);
-      this->countDown -= duration;
+      const double duration = this->cycleDuration();
+      this->countDown -= number * duration;
       if (this->countDown <= 0.0) {
          this->interruptPending = true;
          // reset count down (convert interval from mS to uS).
@@ -49,6 +53,27 @@ void Clock::executeCycle()
    }
 }
 
+//------------------------------------------------------------------------------
+//
+int Clock::cyclesUntilInterrupt(const int maximum) const
+{
+   if (!this->isRunning) return maximum;
+
+   const double cycles = this->countDown / this->cycleDuration();
+   if (cycles >= maximum) return maximum;
+   return MAX(1, int (cycles + 0.999999));
+}
+
+//------------------------------------------------------------------------------
+// A typlical ALP instruction is 2.25 uSec
+// If more than one active device, we should adjust this.
+// Note: it is far from linear, due to bus contention
+//
+double Clock::cycleDuration() const
+{
+   return (3.0 * 2.25) / (this->numberActiveDevices + 2.0);
+}
+
 //------------------------------------------------------------------------------
 //
 void Clock::setNumberActiveDevices(const int n)
@@ -97,5 +122,35 @@ void Clock::setWord(const Int16 addr, const Int16 value)
    }
 }
 
+//------------------------------------------------------------------------------
+//
+void Clock::saveState (std::vector<UInt8>& state) const
+{
+   State saved;
+   memset (&saved, 0, sizeof (saved));
+   saved.countDown = this->countDown;
+   saved.interval = this->interval;
+   saved.isRunning = this->isRunning;
+   saved.interruptPending = this->interruptPending;
+
+   const UInt8* p = reinterpret_cast <const UInt8*> (&saved);
+   state.assign (p, p + sizeof (saved));
+}
+
+//------------------------------------------------------------------------------
+//
+bool Clock::restoreState (const UInt8* state, const size_t size)
+{
+   State saved;
+   if (size != sizeof (saved)) return false;
+   memcpy (&saved, state, sizeof (saved));
+
+   this->countDown = saved.countDown;
+   this->interval = saved.interval;
+   this->isRunning = saved.isRunning;
+   this->interruptPending = saved.interruptPending;
+   return true;
+}
+
 // end
 
@@ -38,8 +38,26 @@ public:
    void setWord(const Int16 addr, const Int16  value);
 
    void executeCycle();   // called prior to each instruction execution
+   void executeCycles(const int number);   // ditto for a number of instructions
+
+   // The number of instructions that may be executed before the next interrupt
+   // becomes pending, or maximum if the clock is not running.
+   //
+   int cyclesUntilInterrupt(const int maximum) const;
+
+   double cycleDuration() const;   // emulated uSec per instruction
+
+   void saveState (std::vector<UInt8>& state) const;
+   bool restoreState (const UInt8* state, const size_t size);
 
 private:
+   struct State {
+      double countDown;
+      Int16 interval;
+      UInt8 isRunning;
+      UInt8 interruptPending;
+   };
+
    int numberActiveDevices;
    bool isRunning;
    Int16 interval;      // in emulated mSec
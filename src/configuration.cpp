@@ -17,6 +17,7 @@
 #include <iostream>
 #include <INIReader.h>
 #include "locus16_common.h"
+#include "machine.h"
 #include "peripheral.h"
 #include "tape_punch.h"
 #include "tape_reader.h"
@@ -43,8 +44,9 @@ Configuration::~Configuration () {}
 //------------------------------------------------------------------------------
 // static
 bool Configuration::readConfiguration (const std::string iniFile,
-                                       DataBus* dataBus)
+                                       Machine* machine)
 {
+   DataBus* const dataBus = machine->getDataBus();
    char sectionText [24];
    char hex [20];
 
@@ -62,12 +64,14 @@ bool Configuration::readConfiguration (const std::string iniFile,
    int error = c->ParseError();
    if (error != 0) {
       std::cerr << iniFile << ": parse error " << error << "\n";
+      delete c;
       return false;
    }
 
    const int numberDevices = c->GetInteger("System", "NumberDevices", -1);
    if (numberDevices < 1) {
       std::cerr << iniFile << ": no devices specified" << "\n";
+      delete c;
       return false;
    }
    const int numberPeripherals = c->GetInteger("System", "NumberPeripherals", 0);
@@ -108,6 +112,8 @@ bool Configuration::readConfiguration (const std::string iniFile,
          std::cerr  << iniFile << ": unknown peripheral kind\n";
          status = false;
       }
+
+      if (peripherals [p]) status &= machine->addPeripheral (peripherals [p]);
    }
    std::cout << "\n";
 
@@ -221,6 +227,7 @@ bool Configuration::readConfiguration (const std::string iniFile,
    }
    std::cout << "\n";
 
+   delete c;
    return status;
 }
 
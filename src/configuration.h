@@ -17,12 +17,15 @@
 
 namespace L16E {
 
+class Machine;
+
 class Configuration {
 public:
-   // Reads configuration data and creates the specified peripherals and devices.
+   // Reads configuration data and creates the specified peripherals and
+   // devices within the machine.
    //
    static bool readConfiguration (const std::string iniFile,
-                                  DataBus* dataBus);
+                                  Machine* machine);
 private:
    explicit Configuration ();
    ~Configuration ();
@@ -143,6 +143,35 @@ void DataBus::Device::setByte(const Int16 addr, const UInt8 value)
    this->setWord (addr & 0xFFFE, data.word);
 }
 
+//------------------------------------------------------------------------------
+//
+UInt8* DataBus::Device::getHostPage (const Int16, const int, const bool)
+{
+   return nullptr;
+}
+
+//------------------------------------------------------------------------------
+//
+bool DataBus::Device::isIdlePoll (const Int16, int& fd) const
+{
+   fd = -1;
+   return false;
+}
+
+//------------------------------------------------------------------------------
+//
+void DataBus::Device::saveState (std::vector<UInt8>& state) const
+{
+   state.clear();
+}
+
+//------------------------------------------------------------------------------
+//
+bool DataBus::Device::restoreState (const UInt8*, const size_t size)
+{
+   return size == 0;
+}
+
 //------------------------------------------------------------------------------
 //
 std::string DataBus::Device::addrRange () const
@@ -163,7 +192,12 @@ DataBus::ActiveDevice::ActiveDevice(DataBus* const dataBus,
                                     const Int16 addrHigh,   // exclusive
                                     const char* name) :
    DataBus::Device (dataBus, addrLow, addrHigh, name, true)
-{ }
+{
+   if ((this->activeIdentity >= 0) &&
+       (this->activeIdentity < maximumNumberOfDevices)) {
+      this->dataBus->activeList [this->activeIdentity] = this;
+   }
+}
 
 //------------------------------------------------------------------------------
 //
@@ -179,6 +213,43 @@ bool DataBus::ActiveDevice::execute()
    return false;
 }
 
+//------------------------------------------------------------------------------
+//
+DataBus::ActiveDevice::RunStatus
+DataBus::ActiveDevice::run (const int maxInstructions, int& count)
+{
+   for (count = 0; count < maxInstructions; ) {
+      const bool status = this->execute();
+      count++;
+      if (!status) return failed;
+   }
+   return completed;
+}
+
+//------------------------------------------------------------------------------
+//
+void DataBus::ActiveDevice::getIdleWait (int& fd, int& loopLength) const
+{
+   fd = -1;
+   loopLength = 1;
+}
+
+//------------------------------------------------------------------------------
+//
+void DataBus::ActiveDevice::memoryModified (const Int16) { }
+
+//------------------------------------------------------------------------------
+//
+void DataBus::ActiveDevice::mappingModified () { }
+
+//------------------------------------------------------------------------------
+//
+void DataBus::ActiveDevice::allMemoryModified () { }
+
+//------------------------------------------------------------------------------
+//
+void DataBus::ActiveDevice::breakPointsModified () { }
+
 
 //==============================================================================
 // NullDevice
@@ -215,7 +286,11 @@ DataBus::DataBus()
 
    for (int d = 0; d < maximumNumberOfDevices; d++) {
       this->crate [d] = nullptr;
+      this->activeList [d] = nullptr;
    }
+
+   this->trappedPages = 0;
+   memset (this->watchBits, 0, sizeof (this->watchBits));
 }
 
 //------------------------------------------------------------------------------
@@ -303,6 +378,128 @@ void DataBus::setWord(const Int16 addr, const Int16 value)
    device->setWord(addr, value);
 }
 
+//------------------------------------------------------------------------------
+//
+UInt8* DataBus::getHostPage (const Int16 addr, const int activeIdentity,
+                             const bool forWriting) const
+{
+   if (this->isTrapped (addr)) return nullptr;
+   Device* device = DataBus::findDevice (addr);
+   return device->getHostPage (addr, activeIdentity, forWriting);
+}
+
+//------------------------------------------------------------------------------
+//
+bool DataBus::isIdlePoll (const Int16 addr, int& fd) const
+{
+   Device* device = DataBus::findDevice (addr);
+   return device->isIdlePoll (addr, fd);
+}
+
+//------------------------------------------------------------------------------
+//
+void DataBus::memoryModified (const Int16 addr)
+{
+   for (int d = 0; d < this->activeCount; d++) {
+      ActiveDevice* device = this->activeList [d];
+      if (device) device->memoryModified (addr);
+   }
+}
+
+//------------------------------------------------------------------------------
+//
+void DataBus::mappingModified (const int activeIdentity)
+{
+   if ((activeIdentity >= 0) && (activeIdentity < this->activeCount)) {
+      ActiveDevice* device = this->activeList [activeIdentity];
+      if (device) device->mappingModified ();
+   }
+}
+
+//------------------------------------------------------------------------------
+//
+void DataBus::allMemoryModified ()
+{
+   for (int d = 0; d < this->activeCount; d++) {
+      ActiveDevice* device = this->activeList [d];
+      if (device) device->allMemoryModified ();
+   }
+}
+
+//------------------------------------------------------------------------------
+//
+void DataBus::breakPointsModified ()
+{
+   for (int d = 0; d < this->activeCount; d++) {
+      ActiveDevice* device = this->activeList [d];
+      if (device) device->breakPointsModified ();
+   }
+}
+
+//------------------------------------------------------------------------------
+//
+void DataBus::setWatchPoint (const Int16 addr, const int kinds)
+{
+   const int index = (addr >> 1) & 0x7FFF;
+   const uint64_t bit = uint64_t (1) << (index & 63);
+
+   for (int k = 0; k < 2; k++) {
+      if (kinds & (1 << k)) {
+         this->watchBits [k][index >> 6] |= bit;
+      } else {
+         this->watchBits [k][index >> 6] &= ~bit;
+      }
+   }
+
+   // Re-evaluate whether the page (2048 words, i.e. 32 bitmap entries) is
+   // still trapped.
+   //
+   const int page = (addr >> 12) & 15;
+   const int first = page * 32;
+   bool isWatched = false;
+   for (int j = first; j < first + 32; j++) {
+      isWatched |= (this->watchBits [0][j] | this->watchBits [1][j]) != 0;
+   }
+
+   const unsigned int was = this->trappedPages;
+   if (isWatched) {
+      this->trappedPages |= 1u << page;
+   } else {
+      this->trappedPages &= ~(1u << page);
+   }
+
+   if (this->trappedPages != was) this->trappingModified ();
+}
+
+//------------------------------------------------------------------------------
+//
+int DataBus::getWatchPoint (const Int16 addr) const
+{
+   int kinds = 0;
+   if (this->isWatched (addr, watchRead)) kinds |= watchRead;
+   if (this->isWatched (addr, watchWrite)) kinds |= watchWrite;
+   return kinds;
+}
+
+//------------------------------------------------------------------------------
+//
+bool DataBus::hasWatchPoints () const
+{
+   return this->trappedPages != 0;
+}
+
+//------------------------------------------------------------------------------
+// The host pages, as returned by getHostPage, have changed for all active
+// devices.
+//
+void DataBus::trappingModified ()
+{
+   for (int d = 0; d < this->activeCount; d++) {
+      ActiveDevice* device = this->activeList [d];
+      if (device) device->mappingModified ();
+   }
+}
+
 //------------------------------------------------------------------------------
 //
 bool DataBus::initialiseDevices ()
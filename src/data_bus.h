@@ -13,7 +13,10 @@
 #define L16E_DATA_BUS_H
 
 #include "locus16_common.h"
+#include <stddef.h>
+#include <stdint.h>
 #include <string>
+#include <vector>
 
 namespace L16E {
 
@@ -83,6 +86,28 @@ public:
       virtual UInt8 getByte(const Int16 addr) const;
       virtual void setByte(const Int16 addr, const UInt8 value);
 
+      // Returns the host memory holding the 4K byte page containing addr, as
+      // seen by the identified active device, or nullptr if the page must be
+      // accessed via getWord/setWord etc. Page content is big endian.
+      // The default is nullptr, i.e. always use the slow path.
+      //
+      virtual UInt8* getHostPage (const Int16 addr, const int activeIdentity,
+                                  const bool forWriting);
+
+      // Returns true if the register at addr was last read as not ready,
+      // i.e. a guest reading it in a loop is just waiting for input. fd is
+      // set to the host file descriptor that becomes readable when input is
+      // available, or -1 if none. The default is false.
+      //
+      virtual bool isIdlePoll (const Int16 addr, int& fd) const;
+
+      // Snapshot support. The device state (not configuration) is saved into
+      // state, and restored from the same bytes - restoreState returns false
+      // if they are not as expected. The default is no state.
+      //
+      virtual void saveState (std::vector<UInt8>& state) const;
+      virtual bool restoreState (const UInt8* state, const size_t size);
+
       std::string addrRange () const;
 
    protected:
@@ -111,6 +136,45 @@ public:
       // Must be overriden by active devices such the the ALP processor.
       //
       virtual bool execute();
+
+      // Reasons for run to return.
+      //
+      enum RunStatus {
+         completed,     // executed all requested instructions
+         breakPoint,    // the next instruction is at a break point
+         atStopAddress, // the next instruction is at the stop address
+         interrupt,     // an interrupt has been requested
+         deviceEvent,   // an I/O page register has been written to
+         idle,          // polling an input device that is not ready
+         failed         // e.g. undefined instruction - the device reports it
+      };
+
+      // Executes upto maxInstructions, returning early on any of the above
+      // events. The number executed is returned in count.
+      // The default implementation calls execute() for each instruction.
+      //
+      virtual RunStatus run (const int maxInstructions, int& count);
+
+      // After run returns idle, the host file descriptor to wait on (or -1)
+      // and the number of instructions per idle loop iteration.
+      //
+      virtual void getIdleWait (int& fd, int& loopLength) const;
+
+      // Active devices may override these to discard any cached copy of
+      // memory content, e.g. predecoded instructions.
+      //
+      virtual void memoryModified (const Int16 addr);
+      virtual void mappingModified ();
+
+      // As above, for all of memory and the mapping, e.g. after a snapshot
+      // is restored.
+      //
+      virtual void allMemoryModified ();
+
+      // Break points have been set or cleared, e.g. translated code that
+      // assumed none may need to be discarded.
+      //
+      virtual void breakPointsModified ();
    };
 
    explicit DataBus();
@@ -122,6 +186,54 @@ public:
    Int16 getWord(const Int16 addr) const;
    void setWord(const Int16 addr, const Int16 value);
 
+   // Returns host page as per Device::getHostPage for the device at addr.
+   //
+   UInt8* getHostPage (const Int16 addr, const int activeIdentity,
+                       const bool forWriting) const;
+
+   // As per Device::isIdlePoll for the device at addr.
+   //
+   bool isIdlePoll (const Int16 addr, int& fd) const;
+
+   // Called by memory devices when memory content modified, and by memory
+   // mapping devices when the map for the identified active device modified.
+   // Passed on to the active device(s).
+   //
+   void memoryModified (const Int16 addr);
+   void mappingModified (const int activeIdentity);
+   void allMemoryModified ();   // passed on to all active devices
+   void breakPointsModified (); // ditto
+
+   // Watch points, exact to the word (a byte access matches the word that
+   // contains it), for reads and/or writes. Each 4K byte page containing a
+   // watched word is trapped, i.e. getHostPage returns nullptr for it, so
+   // accesses to trapped pages take the slow path and are checked against
+   // the watch bitmaps, while accesses to all other pages are unaffected.
+   // Active devices are notified via mappingModified when the set of trapped
+   // pages changes.
+   //
+   enum WatchKinds {
+      watchRead  = 1,
+      watchWrite = 2
+   };
+
+   void setWatchPoint (const Int16 addr, const int kinds);   // 0 clears
+   int getWatchPoint (const Int16 addr) const;                // returns kinds
+   bool hasWatchPoints () const;
+
+   bool isTrapped (const Int16 addr) const
+   {
+      return (this->trappedPages >> ((addr >> 12) & 15)) & 1;
+   }
+
+   // Only meaningful for trapped pages - i.e. call on the slow path.
+   //
+   bool isWatched (const Int16 addr, const int kind) const
+   {
+      const int index = (addr >> 1) & 0x7FFF;
+      return (this->watchBits [kind >> 1][index >> 6] >> (index & 63)) & 1;
+   }
+
    bool initialiseDevices ();
    void listDevices() const;  // prints to stdout
 
@@ -137,10 +249,16 @@ private:
    //
    Device* findDevice (const Int16 addr) const;
 
+   void trappingModified ();
+
    int count;
    int activeCount;
    Device* crate [maximumNumberOfDevices];
+   ActiveDevice* activeList [maximumNumberOfDevices];   // indexed by identity
    Device* nullDevice;
+
+   unsigned int trappedPages;      // bit per page, indexed by address ms nibble
+   uint64_t watchBits [2][512];    // read, write - bit per word address
 };
 
 }
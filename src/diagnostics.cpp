@@ -9,6 +9,10 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "locus16_common.h"
 
@@ -20,14 +24,19 @@ Diagnostics::Diagnostics (DataBus* dataBusIn) :
    dataBus (dataBusIn)
 {
    this->breakCount = 0;
-   for (int j = 0 ; j < ARRAY_LENGTH(this->breakList); j++) {
-      this->breakList [j] = 0;
+   for (int j = 0 ; j < ARRAY_LENGTH(this->breakBits); j++) {
+      this->breakBits [j] = 0;
    }
 }
 
 //------------------------------------------------------------------------------
 //
-Diagnostics::~Diagnostics () { }
+Diagnostics::~Diagnostics ()
+{
+   for (auto& entry : this->breakOptions) {
+      delete entry.second.condition;
+   }
+}
 
 
 //------------------------------------------------------------------------------
@@ -35,11 +44,12 @@ Diagnostics::~Diagnostics () { }
 char* Diagnostics::hex (const Int16 x)
 {
    // All a bit nasty, but it gets the job done.
+   // Per thread, as machines may run on different threads.
    //
-   static int r = 0;
+   static thread_local int r = 0;
 
 #define NUMBER 20
-   static char buffer [NUMBER][6];
+   static thread_local char buffer [NUMBER][6];
    r = (r+1)%NUMBER;
 #undef NUMBER
 
@@ -100,7 +110,7 @@ static const char* shiftIndex [3] = { "L", "A", "LC" };
 
 
 //------------------------------------------------------------------------------
-//
+// static
 bool Diagnostics::isLoadReg (const Int16 instruction)
 {
    return ((instruction & 0xE000) == 0x0000) ||   // 0xxx and 1xxx
@@ -108,7 +118,7 @@ bool Diagnostics::isLoadReg (const Int16 instruction)
 }
 
 //------------------------------------------------------------------------------
-//
+// static
 bool Diagnostics::isCompare (const Int16 instruction)
 {
    return ((instruction & 0xE000) == 0x6000) ||   // 6xxx and 7xxx
@@ -119,10 +129,32 @@ bool Diagnostics::isCompare (const Int16 instruction)
 //
 void Diagnostics::accessAddress (const Int16 addr)
 {
-   char instruction [20] = "NOOP";
-   char strOffset [10] = "";
+   char instruction [20];
 
    const Int16 data = this->dataBus->getWord(addr);
+   // Only conditional jumps look at the previous instruction, and it may
+   // be an I/O register, so don't read it unless needed.
+   //
+   const Int16 prev = ((data & 0xF800) == 0xD000) ? this->dataBus->getWord(addr - 2) : 0;
+   disassemble (data, prev, instruction, sizeof (instruction));
+
+   // Add a little colour if/when this is a break point.
+   //
+   const bool ib = this->isBreakPoint(addr);
+   const char* bp = ib ? "\033[33;1m*" : " ";
+   const char* ap = ib ? "\033[00m"    : "";
+
+   printf ("%s(%s)%s %s  %s\n", bp, hex(addr), ap, hex(data), instruction);
+}
+
+//------------------------------------------------------------------------------
+// static
+void Diagnostics::disassemble (const Int16 data, const Int16 prev,
+                               char* instruction, const size_t size)
+{
+   char strOffset [10] = "";
+
+   snprintf (instruction, size, "NOOP");
 
    const int msb = (data >>  8) & 0xFF;
    const int lsb = data  & 0xFF;
@@ -161,7 +193,7 @@ void Diagnostics::accessAddress (const Int16 addr)
          snprintf (strOffset, sizeof (strOffset),  "%d", offset);
       }
 
-      snprintf (instruction, sizeof (instruction), "%s%s %5s,%s%s",
+      snprintf (instruction, size, "%s%s %5s,%s%s",
                 cmd, reg, strOffset, idx, bytemode);
 
    } else if (b0to3 == 12) {
@@ -176,7 +208,7 @@ void Diagnostics::accessAddress (const Int16 addr)
           snprintf (strOffset, sizeof (strOffset),  "%d", offset);
        }
 
-       snprintf (instruction, sizeof (instruction), "%s   %5s%s%s%s",
+       snprintf (instruction, size, "%s   %5s%s%s%s",
                  cmd, strOffset, comma, idx, indirect);
 
 
@@ -187,11 +219,10 @@ void Diagnostics::accessAddress (const Int16 addr)
       // Look at the prvious instructions.
       // Indicative, not perfect.
       //
-      const Int16 prev = this->dataBus->getWord(addr - 2);
-      if (this->isCompare(prev)) {
+      if (isCompare(prev)) {
          cmd = compareJumpName [b5to6];
 
-      } else if (this->isLoadReg(prev)) {
+      } else if (isLoadReg(prev)) {
          const int prevReg = (prev >> 11) & 3;
          if      (prevReg == 0) { cmd = regAValJumpName [b5to6]; }
          else if (prevReg == 1) { cmd = regRValJumpName [b5to6]; }
@@ -204,7 +235,7 @@ void Diagnostics::accessAddress (const Int16 addr)
       snprintf (strOffset, sizeof (strOffset), ".%+d", offset+2);
       comma = (b15 == 1) ? "," : "";
       idx = "";  // No  ,P for jumps
-      snprintf (instruction, sizeof (instruction), "%s  %5s%s%s%s",
+      snprintf (instruction, size, "%s  %5s%s%s%s",
                 cmd, strOffset, comma, idx, indirect);
 
 
@@ -217,7 +248,7 @@ void Diagnostics::accessAddress (const Int16 addr)
       } else {
          snprintf (strOffset, sizeof (strOffset),  "%d", offset);
       }
-      snprintf (instruction, sizeof (instruction), "%s%s %5s,%s%s",
+      snprintf (instruction, size, "%s%s %5s,%s%s",
                 cmd, reg, strOffset, idx, bytemode);
 
 
@@ -226,7 +257,7 @@ void Diagnostics::accessAddress (const Int16 addr)
       //
       cmd = literalCmdSet [b5to7];
       idx = "L";
-      snprintf (instruction, sizeof (instruction), "%s%s %5d,L", cmd, reg, lsb);
+      snprintf (instruction, size, "%s%s %5d,L", cmd, reg, lsb);
 
    } else if ((data & 0xE7C0) == 0xE740) {
       // Shifts
@@ -245,7 +276,7 @@ void Diagnostics::accessAddress (const Int16 addr)
             mode = 2;
          }
 
-         snprintf (instruction, sizeof (instruction), "%s%s %5d,%s",
+         snprintf (instruction, size, "%s%s %5d,%s",
                    cmd, reg, shift, shiftIndex[mode]);
       }
 
@@ -253,23 +284,15 @@ void Diagnostics::accessAddress (const Int16 addr)
       // Miscellaneous
       //
       if (lsb < 4) {
-         snprintf (instruction, sizeof (instruction), "SETL %5d", lsb);
+         snprintf (instruction, size, "SETL %5d", lsb);
       } else if (lsb == 0x20) {
-         snprintf (instruction, sizeof (instruction), "CLRK");
+         snprintf (instruction, size, "CLRK");
       } else if (lsb == 0x21) {
-         snprintf (instruction, sizeof (instruction), "SETK");
+         snprintf (instruction, size, "SETK");
       } else if (lsb == 0xFF) {
-         snprintf (instruction, sizeof (instruction), "NUL");
+         snprintf (instruction, size, "NUL");
       }
    }
-
-   // Add a little colour if/when this is a break point.
-   //
-   const bool ib = this->isBreakPoint(addr);
-   const char* bp = ib ? "\033[33;1m*" : " ";
-   const char* ap = ib ? "\033[00m"    : "";
-
-   printf ("%s(%s)%s %s  %s\n", bp, hex(addr), ap, hex(data), instruction);
 }
 
 //------------------------------------------------------------------------------
@@ -325,47 +348,86 @@ void Diagnostics::wideDump (const Int16 start, const Int16 finish)
 
 //------------------------------------------------------------------------------
 //
-int Diagnostics::findBreak (const Int16 addr)
+void Diagnostics::setBreak (const Int16 addr)
 {
-   int result = -1;
+   const int index = addr & 0xFFFF;
+   if (this->breakOptions.count (index) > 0) {
+      this->clearBreakOptions (addr);
+      printf ("break point at (%s) now unconditional\n", hex(addr));
+   } else if (this->isBreakPoint (addr)) {
+      printf ("break point already set at (%s)\n", hex(addr));
+   } else {
+      this->breakBits [index >> 6] |= uint64_t (1) << (index & 63);
+      this->breakCount++;
+      this->dataBus->breakPointsModified ();
+      printf ("break point set at (%s)\n", hex(addr));
+   }
+}
 
-   for (int j = 0 ; j < this->breakCount; j++) {
-      if (addr == this->breakList [j]) {
-         result = j;
-         break;
-      }
+//------------------------------------------------------------------------------
+//
+void Diagnostics::setBreak (const Int16 addr, BreakCondition* condition,
+                            const int64_t count)
+{
+   const int index = addr & 0xFFFF;
+   if (!this->isBreakPoint (addr)) {
+      this->breakBits [index >> 6] |= uint64_t (1) << (index & 63);
+      this->breakCount++;
+      this->dataBus->breakPointsModified ();
    }
 
-   return result;
+   this->clearBreakOptions (addr);
+   if (condition || (count > 1)) {
+      BreakOptions& options = this->breakOptions [index];
+      options.condition = condition;
+      options.count = MAX (count, int64_t (1));
+      options.hits = 0;
+   }
+
+   printf ("break point set at (%s)", hex(addr));
+   if (condition) printf (" if %s", condition->getText().c_str());
+   if (count > 1) printf (" count %ld", long (count));
+   printf ("\n");
 }
 
 //------------------------------------------------------------------------------
 //
-void Diagnostics::setBreak (const Int16 addr)
+void Diagnostics::clearBreakOptions (const Int16 addr)
 {
-   int slot = this->findBreak(addr);
-   if (slot >= 0) {
-      printf ("break point already set at (%s)\n", hex(addr));
-   } else if (this->breakCount >= ARRAY_LENGTH (this->breakList)) {
-      printf ("!!!break table full, (%s) not set.\n", hex(addr));
-   } else {
-      this->breakList[this->breakCount++] = addr;
-      printf ("break point set at (%s)\n", hex(addr));
+   auto entry = this->breakOptions.find (addr & 0xFFFF);
+   if (entry != this->breakOptions.end()) {
+      delete entry->second.condition;
+      this->breakOptions.erase (entry);
    }
 }
 
+//------------------------------------------------------------------------------
+// The hits are only counted when the condition is met. With parallel
+// processors, the count is shared, hence the atomic update.
+//
+bool Diagnostics::testBreak (const BreakCondition::State& state)
+{
+   auto entry = this->breakOptions.find (state.p & 0xFFFF);
+   if (entry == this->breakOptions.end()) return true;   // unconditional
+
+   BreakOptions& options = entry->second;
+   if (options.condition && !options.condition->evaluate (state)) return false;
+   if (options.count <= 1) return true;
+
+   const int64_t hits = __atomic_add_fetch (&options.hits, 1, __ATOMIC_RELAXED);
+   return (hits % options.count) == 0;
+}
+
 //------------------------------------------------------------------------------
 //
 void Diagnostics::clearBreak (const Int16 addr)
 {
-   int slot = this->findBreak(addr);
-   if (slot >= 0) {
-      if (slot == this->breakCount - 1) {
-         this->breakCount--;
-      } else {
-         // shuffle up
-         this->breakList[slot] = this->breakList[--this->breakCount];
-      }
+   const int index = addr & 0xFFFF;
+   if (this->isBreakPoint (addr)) {
+      this->breakBits [index >> 6] &= ~(uint64_t (1) << (index & 63));
+      this->breakCount--;
+      this->dataBus->breakPointsModified ();
+      this->clearBreakOptions (addr);
       printf ("break point at (%s) cleared\n", hex(addr));
    } else {
       printf ("no break point currently set at (%s)\n", hex(addr));
@@ -374,22 +436,236 @@ void Diagnostics::clearBreak (const Int16 addr)
 
 //------------------------------------------------------------------------------
 //
-bool Diagnostics::isBreakPoint (const Int16 addr)
+bool Diagnostics::hasBreakPoints () const
 {
-   return this->findBreak(addr) >= 0;
+   return this->breakCount > 0;
 }
 
 //------------------------------------------------------------------------------
+// In address order, =X8000 first.
 //
 void Diagnostics::listBreaks ()
 {
    if (this->breakCount == 0) {
       printf ("None\n");
    } else {
-      for (int j = 0 ; j < this->breakCount; j++) {
-         printf ("%2d (%s)\n", j+1, hex(this->breakList [j]));
+      int number = 0;
+      for (int j = 0; j < 65536; j++) {
+         const Int16 addr = Int16 (j ^ 0x8000);
+         if (this->isBreakPoint (addr)) {
+            number++;
+            printf ("%2d (%s)", number, hex(addr));
+
+            auto entry = this->breakOptions.find (j ^ 0x8000);
+            if (entry != this->breakOptions.end()) {
+               const BreakOptions& options = entry->second;
+               if (options.condition) {
+                  printf (" if %s", options.condition->getText().c_str());
+               }
+               if (options.count > 1) {
+                  printf (" count %ld (%ld so far)", long (options.count),
+                          long (options.hits % options.count));
+               }
+            }
+            printf ("\n");
+         }
+      }
+   }
+}
+
+//------------------------------------------------------------------------------
+//
+void Diagnostics::setWatch (const Int16 addr, const int kinds)
+{
+   if ((addr & 0xF000) == 0x7000) {
+      printf ("!!!watch points not available on the I/O page, (%s) not set.\n", hex(addr));
+      return;
+   }
+
+   const Int16 word = addr & 0xFFFE;
+   const int was = this->dataBus->getWatchPoint (word);
+   this->dataBus->setWatchPoint (word, was | kinds);
+   printf ("%s watch point set at (%s)\n", watchKindImage (was | kinds), hex(word));
+}
+
+//------------------------------------------------------------------------------
+//
+void Diagnostics::clearWatch (const Int16 addr)
+{
+   const Int16 word = addr & 0xFFFE;
+   if (this->dataBus->getWatchPoint (word) != 0) {
+      this->dataBus->setWatchPoint (word, 0);
+      printf ("watch point at (%s) cleared\n", hex(word));
+   } else {
+      printf ("no watch point currently set at (%s)\n", hex(word));
+   }
+}
+
+//------------------------------------------------------------------------------
+//
+void Diagnostics::listWatches ()
+{
+   int number = 0;
+   if (this->dataBus->hasWatchPoints ()) {
+      for (int index = 0; index < 32768; index++) {
+         const Int16 word = Int16 (index << 1);
+         const int kinds = this->dataBus->getWatchPoint (word);
+         if (kinds != 0) {
+            number++;
+            printf ("%2d (%s) %s\n", number, hex(word), watchKindImage (kinds));
+         }
       }
    }
+
+   if (number == 0) printf ("None\n");
+}
+
+//------------------------------------------------------------------------------
+// static
+//
+const char* Diagnostics::watchKindImage (const int kinds)
+{
+   switch (kinds) {
+      case DataBus::watchRead:                       return "read";
+      case DataBus::watchWrite:                      return "write";
+      case DataBus::watchRead | DataBus::watchWrite: return "read/write";
+      default:                                       return "none";
+   }
+}
+
+//------------------------------------------------------------------------------
+// static
+// The group of the instruction with the given ms byte, as per cmdSet and
+// literalCmdSet, with the jumps and shifts separated out.
+//
+const char* Diagnostics::opcodeGroup (const int msiByte)
+{
+   const int b0to3 = (msiByte >> 4) & 15;
+   const int b4    = (msiByte >> 3) & 1;
+   const int b5to7 = msiByte & 7;
+
+   if (b0to3 < 12) return cmdSet [b0to3];
+   if (b0to3 == 12) return (b4 == 0) ? "J" : "JS";
+   if (b0to3 == 13) return (b4 == 0) ? "Jcc" : "MLT";
+
+   // Exxx/Fxxx
+   //
+   static const char* literalGroup [7] = {
+      "SET,L", "ADD,L", "SUB,L", "CMP,L", "AND,L", "NEQ,L", "IOR,L"
+   };
+   if (b5to7 < 7) return literalGroup [b5to7];
+   if (msiByte == 0xFF) return "SHIFT/MISC";   // SHxT and SETL etc. share FF
+   return "SHIFT";
+}
+
+//------------------------------------------------------------------------------
+//
+void Diagnostics::opcodeHistogram (const uint64_t counts [256])
+{
+   typedef std::pair <uint64_t, std::string> Entry;   // count, name
+
+   uint64_t total = 0;
+   for (int msiByte = 0; msiByte < 256; msiByte++) {
+      total += counts [msiByte];
+   }
+   if (total == 0) {
+      printf ("no instructions counted\n");
+      return;
+   }
+
+   std::vector <Entry> groups;
+   std::vector <Entry> bytes;
+   for (int msiByte = 0; msiByte < 256; msiByte++) {
+      if (counts [msiByte] == 0) continue;
+
+      const std::string group = opcodeGroup (msiByte);
+      bool found = false;
+      for (size_t j = 0; j < groups.size(); j++) {
+         if (groups [j].second == group) {
+            groups [j].first += counts [msiByte];
+            found = true;
+            break;
+         }
+      }
+      if (!found) groups.push_back (Entry (counts [msiByte], group));
+
+      char name [20];
+      snprintf (name, sizeof (name), "%02X %s", msiByte, opcodeGroup (msiByte));
+      bytes.push_back (Entry (counts [msiByte], name));
+   }
+
+   // Most frequent first, ties by name.
+   //
+   const auto byFrequency = [] (const Entry& a, const Entry& b) {
+      return (a.first != b.first) ? (a.first > b.first) : (a.second < b.second);
+   };
+   std::sort (groups.begin(), groups.end(), byFrequency);
+   std::sort (bytes.begin(), bytes.end(), byFrequency);
+
+   printf ("instructions: %lu\n", (unsigned long) total);
+   printf ("by group:\n");
+   for (size_t j = 0; j < groups.size(); j++) {
+      printf ("  %-14s %14lu  %6.2f%%\n", groups [j].second.c_str(),
+              (unsigned long) groups [j].first, 100.0 * groups [j].first / total);
+   }
+   printf ("by ms byte:\n");
+   for (size_t j = 0; j < bytes.size(); j++) {
+      printf ("  %-14s %14lu  %6.2f%%\n", bytes [j].second.c_str(),
+              (unsigned long) bytes [j].first, 100.0 * bytes [j].first / total);
+   }
+}
+
+//------------------------------------------------------------------------------
+//
+void Diagnostics::hotSpots (const uint64_t counts [32768], const int number)
+{
+   uint64_t total = 0;
+   std::vector <int> indices;
+   for (int index = 0; index < 32768; index++) {
+      if (counts [index] == 0) continue;
+      total += counts [index];
+      indices.push_back (index);
+   }
+   if (total == 0) {
+      printf ("no instructions counted\n");
+      return;
+   }
+
+   // Most frequent first, ties by address.
+   //
+   const int n = MIN (number, int (indices.size()));
+   std::partial_sort (indices.begin(), indices.begin() + n, indices.end(),
+                      [counts] (const int a, const int b) {
+      return (counts [a] != counts [b]) ? (counts [a] > counts [b]) : (a < b);
+   });
+
+   printf ("instructions: %lu at %d addresses\n", (unsigned long) total, int (indices.size()));
+   for (int j = 0; j < n; j++) {
+      const int index = indices [j];
+      printf ("%14lu %6.2f%% ", (unsigned long) counts [index], 100.0 * counts [index] / total);
+      this->accessAddress (Int16 (2 * index));
+   }
+}
+
+//------------------------------------------------------------------------------
+//
+bool Diagnostics::exportAddressCounts (const uint64_t counts [32768], const char* filename)
+{
+   FILE* file = fopen (filename, "w");
+   if (!file) {
+      perror (filename);
+      return false;
+   }
+
+   fprintf (file, "address,count\n");
+   for (int index = 0; index < 32768; index++) {
+      if (counts [index] == 0) continue;
+      fprintf (file, "%s,%lu\n", hex (Int16 (2 * index)), (unsigned long) counts [index]);
+   }
+
+   const bool status = (fclose (file) == 0);
+   if (!status) perror (filename);
+   return status;
 }
 
 // end
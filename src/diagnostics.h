@@ -8,7 +8,11 @@
 #ifndef L16E_DIAGNOSTICS_H
 #define L16E_DIAGNOSTICS_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
 #include "data_bus.h"
+#include "break_condition.h"
 
 namespace L16E {
 
@@ -22,21 +26,82 @@ public:
    void accessAddress (const Int16 addr);
    void accessAddress (const Int16 start, const Int16 finish);
 
+   // Disassembles the instruction data into text. The previous instruction
+   // word (if known, else 0) determines the naming of conditional jumps.
+   //
+   static void disassemble (const Int16 data, const Int16 prev,
+                            char* text, const size_t size);
+
+   // Break points are held in a bitmap, one bit per address, so checking
+   // is a single test however many are set. Setting an existing break point
+   // removes any condition and count. The active devices are notified when
+   // the set of break points changes, see DataBus::breakPointsModified.
+   //
    void setBreak (const Int16 addr);
    void clearBreak (const Int16 addr);
-   bool isBreakPoint (const Int16 addr);
+   bool hasBreakPoints () const;
    void listBreaks ();
 
+   // Sets a break point that only stops when the condition (if any, else
+   // nullptr) is true, and then only on every count'th such occasion. Takes
+   // ownership of condition, replacing any existing condition and count.
+   //
+   void setBreak (const Int16 addr, BreakCondition* condition, const int64_t count);
+
+   // Called when isBreakPoint (state.p), returns true if the break point
+   // condition and count, if any, are satisfied, i.e. to stop.
+   //
+   bool testBreak (const BreakCondition::State& state);
+
+   bool isBreakPoint (const Int16 addr) const
+   {
+      const int index = addr & 0xFFFF;
+      return (this->breakBits [index >> 6] >> (index & 63)) & 1;
+   }
+
+   // Watch points, kinds as per DataBus::WatchKinds. Not for the I/O page.
+   //
+   void setWatch (const Int16 addr, const int kinds);
+   void clearWatch (const Int16 addr);
+   void listWatches ();
+   static const char* watchKindImage (const int kinds);
+
+   // Lists the opcode counts (indexed by instruction ms byte), by opcode
+   // group and then by ms byte, most frequent first.
+   //
+   void opcodeHistogram (const uint64_t counts [256]);
+
+   // Lists the number most executed instruction addresses, disassembled,
+   // given the counts indexed by word address (address / 2).
+   //
+   void hotSpots (const uint64_t counts [32768], const int number);
+
+   // Writes all non-zero address counts to file as CSV. Returns true if
+   // successful.
+   //
+   bool exportAddressCounts (const uint64_t counts [32768], const char* filename);
+
 private:
    static char* hex (const Int16 x);
-   bool isLoadReg (const Int16 instruction);
-   bool isCompare (const Int16 instruction);
-   int findBreak (const Int16 addr);  // returns slot (0..39) or -1
+   static bool isLoadReg (const Int16 instruction);
+   static bool isCompare (const Int16 instruction);
+   static const char* opcodeGroup (const int msiByte);
 
    DataBus* const dataBus;   // ptr constant, not what is pointed to
 
+   // Break point condition and count, if any.
+   //
+   struct BreakOptions {
+      BreakCondition* condition;   // or nullptr
+      int64_t count;
+      int64_t hits;                // condition met
+   };
+
+   void clearBreakOptions (const Int16 addr);
+
    int breakCount;
-   Int16 breakList [40];
+   uint64_t breakBits [1024];   // bit per address
+   std::map<int, BreakOptions> breakOptions;   // by address & 0xFFFF
 };
 
 }
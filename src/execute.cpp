@@ -22,6 +22,17 @@
 #include <readline/history.h>
 #include <signal.h>
 #include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sched.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include "locus16_common.h"
 #include "alp_processor.h"
@@ -29,9 +40,13 @@
 #include "configuration.h"
 #include "data_bus.h"
 #include "diagnostics.h"
+#include "io_request_queue.h"
+#include "machine.h"
 #include "memory.h"
+#include "pacer.h"
 #include "rom.h"
 #include "serial.h"
+#include "snapshot.h"
 #include "tape_punch.h"
 #include "tape_reader.h"
 #include "terminal.h"
@@ -68,98 +83,1123 @@ static bool startsWith(const char* text, const char* with)
 }
 
 //------------------------------------------------------------------------------
+// Maximum number of instructions an active device executes per turn. Smaller
+// when there is more than one, as they may be co-operating via memory.
 //
-template<class PeripheralType>
-static PeripheralType* findPeripheral ()
+static const int maximumBatchSize = 10000;
+static const int maximumSharedBatchSize = 100;
+
+// Emulated uSec per instruction when there is no clock device.
+//
+static const double nominalCycleDuration = 2.25;
+
+// Number of hot spots listed by default.
+//
+static const int defaultHotSpots = 20;
+
+// Trace buffer capacity (records) by default, i.e. 16 MByte.
+//
+static const int defaultTraceCapacity = 1 << 20;
+
+//------------------------------------------------------------------------------
+// How the machine is run, as established by run().
+//
+struct Session {
+   L16E::Machine* machine;
+   L16E::DataBus::ActiveDevice* activeDeviceList [L16E::DataBus::maximumNumberOfDevices];
+   int activeCount;
+   int activeDevice;     // for round robin
+   L16E::ALP_Processor* processorList [L16E::DataBus::maximumNumberOfDevices];
+   int processorCount;
+   bool runInParallel;
+   L16E::Pacer pacer;    // emulated time kept to (a multiple of) real time
+   bool fastForward;
+   bool stopWhenBlocked; // stop when input can never become available
+   int untilAddress;     // see runUntilStopped, -1 for none
+};
+
+//------------------------------------------------------------------------------
+// Blocks the host until any of the number fds becomes readable, a signal is
+// received (e.g. SIGINT) or maximum uSec have elapsed. Negative fds are
+// ignored. Returns true if any fd is readable, and the elapsed uSec.
+//
+static bool idleWait (const int* fdList, const int number,
+                      const double maximum, double& elapsed)
+{
+   struct pollfd pfdList [L16E::DataBus::maximumNumberOfDevices];
+   for (int j = 0; j < number; j++) {
+      pfdList [j].fd = fdList [j];
+      pfdList [j].events = POLLIN;
+      pfdList [j].revents = 0;
+   }
+
+   const long usec = long (maximum);
+   struct timespec timeout;
+   timeout.tv_sec = usec / 1000000;
+   timeout.tv_nsec = (usec % 1000000) * 1000;
+
+   struct timespec startTime;
+   struct timespec endTime;
+   clock_gettime (CLOCK_MONOTONIC, &startTime);
+   const int n = ppoll (pfdList, number, &timeout, nullptr);
+   clock_gettime (CLOCK_MONOTONIC, &endTime);
+
+   elapsed = 1.0e6 * (endTime.tv_sec - startTime.tv_sec) +
+             1.0e-3 * (endTime.tv_nsec - startTime.tv_nsec);
+   return (n > 0);
+}
+
+//------------------------------------------------------------------------------
+// Reports a stop at a break point, or at a watch point hit, in which case the
+// instruction that hit it is also shown.
+//
+static void reportBreak (L16E::DataBus::ActiveDevice* device,
+                         L16E::Diagnostics* diagnostics)
+{
+   L16E::ALP_Processor* processor = dynamic_cast <L16E::ALP_Processor*> (device);
+   L16E::ALP_Processor::WatchHit hit;
+
+   if (processor && processor->getWatchHit (hit)) {
+      printf ("watch point %s: %s (%04X) value %04X, level %u\n",
+              device->getName(),
+              (hit.kind == L16E::DataBus::watchRead) ? "read" : "write",
+              hit.location & 0xFFFF, hit.value & 0xFFFF, hit.level);
+      diagnostics->accessAddress (hit.address);
+   } else {
+      std::cout << "break point " << device->getName() << std::endl;
+   }
+}
+
+//------------------------------------------------------------------------------
+// Runs the active devices, in turn, until number instructions have been
+// executed in total, or until a break point, the stop address, a failure or
+// SIGINT (returns interrupt). When stopWhenBlocked is set, also returns idle
+// when the only device is polling for input from a peripheral with nothing to
+// wait on, e.g. a tape reader at the end of the tape. The number of
+// instructions executed is returned in executed.
+//
+static L16E::DataBus::ActiveDevice::RunStatus
+runRoundRobin (Session& session, const int64_t number, int64_t& executed)
 {
-   const int n = L16E::Peripheral::peripheralCount();
-   for (int p = 0; p < n; p++) {
-      PeripheralType* peripheral = dynamic_cast <PeripheralType*> (L16E::Peripheral::getPeripheral(p));
-      if (peripheral) {
-         // Found it (or the first at least)
-         return peripheral;
+   L16E::Machine* const machine = session.machine;
+   L16E::DataBus::ActiveDevice* const* const activeDeviceList = session.activeDeviceList;
+   const int activeCount = session.activeCount;
+   int& activeDevice = session.activeDevice;   // last device to have had a turn
+   const bool fastForward = session.fastForward;
+   L16E::Pacer& pacer = session.pacer;
+
+   L16E::Diagnostics* const diagnostics = machine->getDiagnostics();
+   L16E::MemoryMapper* const mapper = machine->getMapper();
+   L16E::Clock* const clock = machine->getClock();
+   L16E::ALP_Processor* const processor1 = machine->getProcessor (1);
+
+   // Round robin all active devices. See runParallel (-p) for a separate
+   // thread per ALP processor.
+   //
+   // Each device executes a batch of instructions, the batch being
+   // limited so that a clock interrupt is requested at the same point
+   // as if we did the round robin one instruction at a time.
+   //
+   int64_t& ic = executed;
+   for (ic = 0; ic < number; ) {
+      // First check for any user command-line interrupt.
+      //
+      if (sigIntReceived) {
+         sigIntReceived = false;
+         return L16E::DataBus::ActiveDevice::interrupt;
+      }
+
+      // Do the round-robin update and select the active device.
+      //
+      activeDevice = (activeDevice + 1) % activeCount;
+      L16E::DataBus::ActiveDevice* device = activeDeviceList [activeDevice];
+      L16E::ALP_Processor* processor = dynamic_cast <L16E::ALP_Processor*> (device);
+
+      // Let memory mapper controller know who is (or will be)
+      // trying to access memory.
+      //
+      int id = device->getActiveIdentity();
+      if (mapper) mapper->setActiveIdentity(id);
+
+      // Check for the stop address and break points - the processor checks
+      // all but the first instruction of each batch.
+      //
+      if ((ic > 0) && processor && processor->isAtStopAddress()) {
+         return L16E::DataBus::ActiveDevice::atStopAddress;
+      }
+
+      if ((ic > 0) && processor && diagnostics->hasBreakPoints()) {
+         if (processor->isAtBreakPoint()) {
+            // At a break point
+            std::cout << "break point " << device->getName() << std::endl;
+            return L16E::DataBus::ActiveDevice::breakPoint;
+         }
+      }
+
+      // Only primary ALP gets interrupted by the clock.
+      //
+      if (clock && clock->testAndClearInterruptPending()) {
+         if (processor1) processor1->requestInterrupt();
+      }
+
+      int batch = MIN (number - ic, maximumBatchSize);
+      if (activeCount > 1) batch = MIN (batch, maximumSharedBatchSize);
+      if (clock) batch = clock->cyclesUntilInterrupt (batch);
+
+      int count = 0;
+      const L16E::DataBus::ActiveDevice::RunStatus runStatus =
+            device->run (batch, count);
+      int paced = count;   // excludes any fast forward
+
+      // The device is just polling for input (or with fast forward, just
+      // waiting). If it is the only active device then, rather than spin,
+      // we block the host until input is available or until the rest of
+      // the batch, which ends no later than the next clock interrupt,
+      // would have elapsed at the current speed. With fast forward or when
+      // unthrottled, we don't wait at all. The skipped idle loop iterations
+      // would not have changed anything.
+      //
+      if ((runStatus == L16E::DataBus::ActiveDevice::idle) && (activeCount == 1)) {
+         int fd;
+         int loopLength;
+         device->getIdleWait (fd, loopLength);
+
+         // Without fast forward, only polling loops are idle, and with no
+         // descriptor to wait on, the input can never become ready.
+         //
+         if (session.stopWhenBlocked && !fastForward && (fd < 0)) {
+            ic += count;
+            if (clock) clock->executeCycles (count);
+            return L16E::DataBus::ActiveDevice::idle;
+         }
+
+         const int iterations = (batch - count) / loopLength;
+         if (iterations > 0) {
+            // Real uSec per instruction.
+            //
+            const double speed = pacer.getSpeed();
+            const double duration = (clock ? clock->cycleDuration() : nominalCycleDuration) /
+                                    ((speed > 0.0) ? speed : 1.0);
+            double elapsed;
+            if (fastForward || (speed <= 0.0)) {
+               if (!idleWait (&fd, 1, 0.0, elapsed)) count += iterations * loopLength;
+               if (!fastForward) paced = count;
+            } else {
+               idleWait (&fd, 1, iterations * loopLength * duration, elapsed);
+               const int skipped = MIN (iterations, int (elapsed / (loopLength * duration)));
+               count += skipped * loopLength;
+               paced = count;
+            }
+         }
+      }
+
+      ic += count;
+
+      pacer.executeCycles (paced);
+
+      // Let clock know we have executed count instructions.
+      // This adds 2.25 or 1.68 uSec per instruction to the amount of
+      // time that has passed (based on the number of active/ALP
+      // processors in the crate).
+      //
+      if (clock) clock->executeCycles (count);
+
+      if (runStatus == L16E::DataBus::ActiveDevice::breakPoint) {
+         reportBreak (device, diagnostics);
+         return runStatus;
+      }
+
+      if (runStatus == L16E::DataBus::ActiveDevice::atStopAddress) {
+         return runStatus;
+      }
+
+      if (runStatus == L16E::DataBus::ActiveDevice::failed) {
+         // The device reports the error.
+         if (processor) diagnostics->accessAddress(processor->getPreg() - 2);
+         return runStatus;
       }
    }
-   return nullptr;
+
+   return L16E::DataBus::ActiveDevice::completed;
 }
 
 //------------------------------------------------------------------------------
+// Runs each processor on its own host thread until number instructions have
+// been executed in total, or until a break point, the stop address, a failure
+// or SIGINT (returns interrupt). Memory pages are accessed directly by each
+// thread; all other data bus accesses are passed to this (the main) thread via
+// each processor's I/O request queue, so that devices need not be thread safe.
+//
+// The threads do not run past the total instruction count at which the next
+// clock interrupt is due until this thread has caught up with them, so clock
+// interrupts are requested at much the same point as in the round robin case,
+// although not instruction exact. Likewise they do not run more than a pacing
+// interval ahead of real time. When every processor is just polling for
+// input, this thread waits as per runRoundRobin, including returning idle
+// when stopWhenBlocked is set. The number of instructions executed is
+// returned in executed.
 //
-template<class DeviceType>
-static DeviceType* findDevice (L16E::DataBus* const dataBus, int ordinal = 1)
+static L16E::DataBus::ActiveDevice::RunStatus
+runParallel (Session& session, const int64_t number, int64_t& executedOut)
 {
-   const int n = dataBus->deviceCount();
-   for (int d = 0; d < n; d++) {
-      DeviceType* device = dynamic_cast <DeviceType*> (dataBus->getDevice(d));
-      if (device) {
-         // Found it the required class
-         if (ordinal == 1) {
-            // Found it the required instance
-            return device;
+   L16E::Machine* const machine = session.machine;
+   L16E::ALP_Processor* const* const processorList = session.processorList;
+   const int processorCount = session.processorCount;
+   L16E::Pacer& pacer = session.pacer;
+
+   L16E::DataBus* const dataBus = machine->getDataBus();
+   L16E::Diagnostics* const diagnostics = machine->getDiagnostics();
+   L16E::Clock* const clock = machine->getClock();
+   L16E::ALP_Processor* const processor1 = machine->getProcessor (1);
+
+   L16E::IoRequestQueue* queueList [L16E::DataBus::maximumNumberOfDevices];
+   std::thread threadList [L16E::DataBus::maximumNumberOfDevices];
+
+   std::atomic <int64_t> executed (0);
+   std::atomic <int> running (processorCount);
+   std::atomic <bool> stop (false);
+
+   // Threads do not run past this total, as set by this thread from the next
+   // clock interrupt and the pacing, given total executed and accounted for.
+   //
+   const int largeBatch = 1 << 30;
+   auto nextDeadline = [&] (const int64_t total, const int64_t accounted) -> int64_t {
+      int64_t result = total + pacer.cyclesUntilAhead (largeBatch);
+      if (clock) result = MIN (result, accounted + clock->cyclesUntilInterrupt (largeBatch));
+      return result;
+   };
+   std::atomic <int64_t> deadline (nextDeadline (0, 0));
+
+   // Threads held at the deadline wait here. Whoever moves the deadline or
+   // sets stop calls release. The waiting count and the deadline are both
+   // sequentially consistent, so either the waiting thread sees the change
+   // or release sees the thread waiting.
+   //
+   std::mutex gateMutex;
+   std::condition_variable gate;
+   std::atomic <int> waiting (0);
+   auto release = [&] () {
+      if (waiting.load() > 0) {
+         std::lock_guard <std::mutex> lock (gateMutex);
+         gate.notify_all();
+      }
+   };
+
+   // Set by a thread whose processor returned idle, with the descriptor to
+   // wait on, if any, and cleared by this thread. The thread waits at the
+   // gate meanwhile.
+   //
+   std::atomic <bool> isIdle [L16E::DataBus::maximumNumberOfDevices];
+   int idleFd [L16E::DataBus::maximumNumberOfDevices];
+   bool blocked = false;
+
+   // Set by the first processor to stop at a break point, at the stop
+   // address or on failure.
+   //
+   std::atomic <int> stopper (-1);
+   L16E::DataBus::ActiveDevice::RunStatus stopStatus = L16E::DataBus::ActiveDevice::completed;
+
+   for (int j = 0; j < processorCount; j++) {
+      L16E::ALP_Processor* processor = processorList [j];
+      queueList [j] = new L16E::IoRequestQueue (dataBus, machine->getMapper(),
+                                                processor->getActiveIdentity());
+      processor->setIoRequestQueue (queueList [j]);
+      isIdle [j].store (false);
+   }
+
+   for (int j = 0; j < processorCount; j++) {
+      threadList [j] = std::thread ([&, j] () {
+         L16E::ALP_Processor* processor = processorList [j];
+         bool isFirst = true;
+
+         while (!stop.load (std::memory_order_relaxed)) {
+            const int64_t total = executed.load (std::memory_order_relaxed);
+            if (total >= number) break;
+
+            const int64_t remaining = MIN (number, deadline.load (std::memory_order_acquire)) - total;
+            if (remaining <= 0) {
+               // Wait for the main thread to catch up.
+               //
+               std::unique_lock <std::mutex> lock (gateMutex);
+               waiting.fetch_add (1);
+               gate.wait (lock, [&] () {
+                  const int64_t now = executed.load();
+                  return stop.load() || (now >= number) || (MIN (number, deadline.load()) > now);
+               });
+               waiting.fetch_sub (1);
+               continue;
+            }
+
+            // Check for the stop address and break points - the processor
+            // checks all but the first instruction of each batch.
+            //
+            L16E::DataBus::ActiveDevice::RunStatus atStatus =
+                  L16E::DataBus::ActiveDevice::completed;
+            if (!isFirst && processor->isAtStopAddress()) {
+               atStatus = L16E::DataBus::ActiveDevice::atStopAddress;
+            } else if (!isFirst && diagnostics->hasBreakPoints() &&
+                       processor->isAtBreakPoint())
+            {
+               atStatus = L16E::DataBus::ActiveDevice::breakPoint;
+            }
+
+            if (atStatus != L16E::DataBus::ActiveDevice::completed) {
+               int expected = -1;
+               if (stopper.compare_exchange_strong (expected, j)) {
+                  stopStatus = atStatus;
+               }
+               stop.store (true);
+               release();
+               break;
+            }
+            isFirst = false;
+
+            const int batch = int (MIN (remaining, int64_t (maximumBatchSize)));
+            int count = 0;
+            const L16E::DataBus::ActiveDevice::RunStatus runStatus =
+                  processor->run (batch, count);
+
+            executed.fetch_add (count, std::memory_order_relaxed);
+
+            if (runStatus == L16E::DataBus::ActiveDevice::idle) {
+               int loopLength;
+               processor->getIdleWait (idleFd [j], loopLength);
+
+               std::unique_lock <std::mutex> lock (gateMutex);
+               waiting.fetch_add (1);
+               isIdle [j].store (true);
+               gate.wait (lock, [&] () { return stop.load() || !isIdle [j].load(); });
+               waiting.fetch_sub (1);
+               continue;
+            }
+
+            if ((runStatus == L16E::DataBus::ActiveDevice::breakPoint) ||
+                (runStatus == L16E::DataBus::ActiveDevice::atStopAddress) ||
+                (runStatus == L16E::DataBus::ActiveDevice::failed))
+            {
+               int expected = -1;
+               if (stopper.compare_exchange_strong (expected, j)) {
+                  stopStatus = runStatus;
+               }
+               stop.store (true);
+               release();
+               break;
+            }
          }
-         ordinal--;
+
+         running.fetch_sub (1, std::memory_order_release);
+         release();   // others may now be done
+      });
+   }
+
+   // Service the I/O requests, the clock and the pacing until all threads
+   // are done. We keep servicing after a stop as a thread may be part way
+   // through a request. When ahead of real time, this thread sleeps in the
+   // pacer while the threads wait at the deadline or for an I/O request.
+   //
+   int64_t accounted = 0;
+   int64_t paced = 0;
+   bool interrupted = false;
+   while (running.load (std::memory_order_acquire) > 0) {
+      bool isBusy = false;
+      for (int j = 0; j < processorCount; j++) {
+         isBusy |= queueList [j]->service();
+      }
+
+      const int64_t total = executed.load (std::memory_order_relaxed);
+      if (clock) {
+         if (total > accounted) {
+            clock->executeCycles (int (total - accounted));
+            accounted = total;
+         }
+
+         // Only primary ALP gets interrupted by the clock.
+         //
+         if (clock->testAndClearInterruptPending()) {
+            if (processor1) processor1->requestInterrupt();
+         }
+      }
+
+      if (total > paced) {
+         pacer.executeCycles (int (total - paced));
+         paced = total;
       }
+
+      const int64_t next = nextDeadline (total, accounted);
+      if (next != deadline.load()) {
+         deadline.store (next);
+         release();
+      }
+
+      if (sigIntReceived) {
+         sigIntReceived = false;
+         interrupted = true;
+         stop.store (true);
+         release();
+      }
+
+      // When every processor is just polling for input, then rather than
+      // spin, we block the host until input is available or until the
+      // instructions upto the next clock interrupt would have elapsed at the
+      // current speed, as per runRoundRobin. When only some are, one of the
+      // others may yet provide the input, so they carry on.
+      //
+      int fdList [L16E::DataBus::maximumNumberOfDevices];
+      int idleCount = 0;
+      bool canUnblock = false;
+      for (int j = 0; j < processorCount; j++) {
+         if (isIdle [j].load()) {
+            fdList [idleCount++] = idleFd [j];
+            canUnblock |= (idleFd [j] >= 0);
+         }
+      }
+
+      if ((idleCount > 0) && !stop.load() && (idleCount == running.load())) {
+         const int64_t now = executed.load();
+         int64_t limit = number;
+         if (clock) limit = MIN (limit, accounted + clock->cyclesUntilInterrupt (largeBatch));
+         const int64_t remaining = MIN (limit - now, int64_t (maximumBatchSize));
+
+         if (session.stopWhenBlocked && !canUnblock) {
+            // The input can never become ready.
+            //
+            blocked = true;
+            stop.store (true);
+
+         } else if (remaining > 0) {
+            // Real uSec per instruction. Clock interrupts are not instruction
+            // exact, so we need not skip whole idle loop iterations.
+            //
+            const double speed = pacer.getSpeed();
+            const double duration = (clock ? clock->cycleDuration() : nominalCycleDuration) /
+                                    ((speed > 0.0) ? speed : 1.0);
+            double elapsed;
+            if (speed <= 0.0) {
+               if (!idleWait (fdList, idleCount, 0.0, elapsed)) executed.fetch_add (remaining);
+            } else {
+               idleWait (fdList, idleCount, remaining * duration, elapsed);
+               executed.fetch_add (MIN (remaining, int64_t (elapsed / duration)));
+            }
+         }
+      }
+
+      if (idleCount > 0) {
+         for (int j = 0; j < processorCount; j++) {
+            isIdle [j].store (false);
+         }
+         release();
+      }
+
+      if (!isBusy) sched_yield();
+   }
+
+   for (int j = 0; j < processorCount; j++) {
+      threadList [j].join();
+      processorList [j]->setIoRequestQueue (nullptr);
+      delete queueList [j];
    }
-   return nullptr;
+
+   if (clock && (executed.load() > accounted)) {
+      clock->executeCycles (int (executed.load() - accounted));
+   }
+
+   executedOut = executed.load();
+
+   const int j = stopper.load();
+   if (j >= 0) {
+      L16E::ALP_Processor* processor = processorList [j];
+      if (stopStatus == L16E::DataBus::ActiveDevice::breakPoint) {
+         reportBreak (processor, diagnostics);
+      } else if (stopStatus == L16E::DataBus::ActiveDevice::failed) {
+         // The device reports the error.
+         diagnostics->accessAddress (processor->getPreg() - 2);
+      }
+   }
+   if ((j < 0) && interrupted) return L16E::DataBus::ActiveDevice::interrupt;
+   if ((j < 0) && blocked) return L16E::DataBus::ActiveDevice::idle;
+   return stopStatus;
 }
 
 //------------------------------------------------------------------------------
+// Runs the machine for number instructions, either round robin or in
+// parallel as specified. The number actually executed is returned in executed.
 //
-int run (const std::string iniFile,
-         const std::string programFile,
-         const std::string outputFile,
-         const int sleepModulo)
+static L16E::DataBus::ActiveDevice::RunStatus
+runSession (Session& session, const int64_t number, int64_t& executed)
 {
-   bool status;
-   L16E::DataBus* const dataBus = new L16E::DataBus();
-   L16E::Diagnostics* const diagnostics = new L16E::Diagnostics (dataBus);
+   executed = 0;
+
+   // Don't try to catch up on any time spent stopped.
+   //
+   session.pacer.reset();
+
+   if (session.runInParallel) {
+      return runParallel (session, number, executed);
+   } else {
+      return runRoundRobin (session, number, executed);
+   }
+}
 
-   status = L16E::Configuration::readConfiguration(iniFile, dataBus);
-   if (!status) return 4;
+//------------------------------------------------------------------------------
+// Parses the options following the SB address, i.e. nothing, or either or
+// both of "if condition" and "count number", in either order. The condition
+// extends to the end of the line, or to a final count clause.
+//
+static bool parseBreakOptions (const char* text, std::string& condition,
+                               int64_t& count)
+{
+   condition = "";
+   count = 1;
+
+   while (true) {
+      while (isspace (int (*text))) text++;
+      if (*text == '\0') return true;
+
+      if (startsWith (text, "count") && isspace (int (text [5]))) {
+         long number;
+         int length = 0;
+         if ((sscanf (text + 5, "%ld%n", &number, &length) != 1) || (number < 1)) {
+            return false;
+         }
+         count = number;
+         text += 5 + length;
 
-   // List all available peripherals and devices.
-   // Bah!! This is a bit asymetric.
+      } else if (startsWith (text, "if") && isspace (int (text [2]))) {
+         text += 2;
+         while (isspace (int (*text))) text++;
+         std::string rest = text;
+         text = "";
+
+         // Look for a trailing count clause.
+         //
+         const size_t n = rest.size();
+         for (size_t j = n; j-- > 0; ) {
+            if (!isspace (int (rest [j])) || (j + 6 >= n) ||
+                !startsWith (rest.c_str() + j + 1, "count") ||
+                !isspace (int (rest [j + 6]))) continue;
+
+            long number;
+            int length = 0;
+            const char* clause = rest.c_str() + j + 6;
+            if ((sscanf (clause, "%ld %n", &number, &length) == 1) &&
+                (clause [length] == '\0') && (number >= 1))
+            {
+               count = number;
+               rest.erase (j);
+            }
+            break;
+         }
+         condition = rest;
+
+      } else {
+         return false;
+      }
+   }
+}
+
+//------------------------------------------------------------------------------
+// True when every processor is sitting on a jump to itself (J .), the
+// conventional way for a program to halt.
+//
+static bool isHalted (Session& session)
+{
+   static const Int16 jumpToSelf = Int16 (0xC102);
+
+   L16E::DataBus* const dataBus = session.machine->getDataBus();
+   L16E::MemoryMapper* const mapper = session.machine->getMapper();
+
+   if (session.processorCount <= 0) return false;
+   for (int j = 0; j < session.processorCount; j++) {
+      L16E::ALP_Processor* processor = session.processorList [j];
+      if (mapper) mapper->setActiveIdentity (processor->getActiveIdentity());
+      if (dataBus->getWord (processor->getPreg()) != jumpToSelf) return false;
+   }
+   return true;
+}
+
+//------------------------------------------------------------------------------
+// True when the last run stopped at a watch point hit, as opposed to a break
+// point.
+//
+static bool isWatchHit (Session& session)
+{
+   L16E::ALP_Processor::WatchHit hit;
+   for (int j = 0; j < session.processorCount; j++) {
+      if (session.processorList [j]->getWatchHit (hit)) return true;
+   }
+   return false;
+}
+
+//------------------------------------------------------------------------------
+// Runs until the primary processor reaches the until address (if any), the
+// program halts, the input runs out, a break or watch point is hit, the
+// processor fails, SIGINT or maxInstructions have been executed. Returns the
+// batch status (see execute.h), the number of instructions executed in total
+// and the reason for stopping.
+//
+static int runUntilStopped (Session& session,
+                            const int64_t maxInstructions,
+                            int64_t& total,
+                            const char*& reason)
+{
+   // Halting is checked between chunks.
    //
-   L16E::Peripheral::listPeripherals();
-   dataBus->listDevices();
+   static const int64_t chunkSize = 1000000;
 
-   L16E::DataBus::ActiveDevice* activeDeviceList [L16E::DataBus::maximumNumberOfDevices];
+   // The stop address, unlike a break point, does not preclude the block
+   // engines.
+   //
+   L16E::ALP_Processor* const processor1 = session.machine->getProcessor (1);
+   const bool hasUntilAddress = processor1 && (session.untilAddress >= 0);
+   if (hasUntilAddress) processor1->setStopAddress (session.untilAddress);
+
+   total = 0;
+   int result = batchBudgetExhausted;
+   reason = "instruction budget exhausted";
+
+   sigIntReceived = false;
+   while (total < maxInstructions) {
+      int64_t executed;
+      const L16E::DataBus::ActiveDevice::RunStatus runStatus =
+            runSession (session, MIN (maxInstructions - total, chunkSize), executed);
+      total += executed;
+
+      if (runStatus == L16E::DataBus::ActiveDevice::atStopAddress) {
+         result = batchStopped;
+         reason = "until address reached";
+         break;
+      }
+
+      if (runStatus == L16E::DataBus::ActiveDevice::breakPoint) {
+         result = batchStopped;
+         reason = isWatchHit (session) ? "watch point hit" : "break point";
+         break;
+      }
+
+      if (runStatus == L16E::DataBus::ActiveDevice::failed) {
+         result = batchFailed;
+         reason = "processor failed";
+         break;
+      }
+
+      if (runStatus == L16E::DataBus::ActiveDevice::interrupt) {
+         result = batchInterrupted;
+         reason = "interrupted";
+         break;
+      }
+
+      if (runStatus == L16E::DataBus::ActiveDevice::idle) {
+         result = batchStopped;
+         reason = "end of input";
+         break;
+      }
+
+      // A chunk may end just as the until address is reached, which is not
+      // checked at the start of the next.
+      //
+      if (processor1 && processor1->isAtStopAddress()) {
+         result = batchStopped;
+         reason = "until address reached";
+         break;
+      }
+
+      if (isHalted (session)) {
+         result = batchStopped;
+         reason = "halted";
+         break;
+      }
+   }
+
+   if (hasUntilAddress) processor1->setStopAddress (-1);
+   return result;
+}
+
+//------------------------------------------------------------------------------
+// Runs one test case in a child process: points the tape reader and punch at
+// the case's files, and runs unthrottled, as per batch mode, until the case is
+// done or number instructions have been executed. Returns the child's exit
+// status, as per batch mode, i.e. a BatchStatus, where batchSetupFailed means
+// a tape file could not be opened.
+//
+static int runTestCase (Session& session,
+                        const std::string input,
+                        const std::string output,
+                        const int64_t number)
+{
+   L16E::Machine* const machine = session.machine;
+
+   L16E::TapeReader* reader = machine->findPeripheral<L16E::TapeReader>();
+   if (reader) {
+      reader->setFilename (input);
+      if (!reader->initialise()) return batchSetupFailed;
+   }
+
+   L16E::TapePunch* punch = machine->findPeripheral<L16E::TapePunch>();
+   if (punch) {
+      punch->setFilename (output);
+      if (!punch->initialise()) return batchSetupFailed;
+   }
+
+   // The child has its own copy of the session.
+   //
+   session.pacer.setSpeed (0.0);
+   session.stopWhenBlocked = true;
+
+   int64_t total;
+   const char* reason;
+   return runUntilStopped (session, number, total, reason);
+}
+
+//------------------------------------------------------------------------------
+// Template machine mode. Each test case listed in caseFile runs in its own
+// child process forked from this one, so each case starts from the current
+// machine state (e.g. just booted) with memory shared copy on write, rather
+// than from scratch. Each line of the file specifies the input tape and the
+// output tape for one case, and each case runs unthrottled until it halts,
+// its input runs out or it reaches the until address, if any, but for no more
+// than number instructions. Upto one case per host processor runs at a time.
+//
+static void runTestCases (Session& session,
+                          const char* caseFile,
+                          const int64_t number)
+{
+   struct TestCase {
+      std::string input;
+      std::string output;
+      pid_t pid;
+   };
+   std::vector<TestCase> cases;
+
+   FILE* file = fopen (caseFile, "r");
+   if (!file) {
+      perror (caseFile);
+      return;
+   }
+
+   char line [600];
+   while (fgets (line, sizeof (line), file)) {
+      const char* text = line;
+      while (isspace (int (*text))) text++;
+      if ((*text == '\0') || (*text == '#') || startsWith (text, "//")) continue;
+
+      char input [256];
+      char output [256];
+      if (sscanf (text, "%255s %255s", input, output) != 2) {
+         std::cout << "Invalid test case: " << text;
+         continue;
+      }
+
+      TestCase testCase;
+      testCase.input = input;
+      testCase.output = output;
+      testCase.pid = -1;
+      cases.push_back (testCase);
+   }
+   fclose (file);
+
+   // Indexed by BatchStatus.
+   //
+   static const char* const outcomes [5] = {
+      "completed", "instruction budget exhausted", "failed", "interrupted",
+      "set up failed"
+   };
+
+   const int numberCases = cases.size();
+   const int maximumRunning = MAX (1, int (sysconf (_SC_NPROCESSORS_ONLN)));
+   int running = 0;
+   int started = 0;
+   int completed = 0;
+
+   while (((started < numberCases) && !sigIntReceived) || (running > 0)) {
+      if ((started < numberCases) && !sigIntReceived && (running < maximumRunning)) {
+         // Don't let the child inherit, and so repeat, any buffered output.
+         //
+         std::cout.flush();
+         fflush (stdout);
+
+         TestCase& testCase = cases [started];
+         const pid_t pid = fork();
+         if (pid == 0) {
+            const int status = runTestCase (session, testCase.input, testCase.output, number);
+            std::cout.flush();
+            fflush (stdout);
+            _exit (status);
+         }
+
+         if (pid < 0) {
+            perror ("fork");
+            break;
+         }
+
+         testCase.pid = pid;
+         started++;
+         running++;
+         continue;
+      }
+
+      int waitStatus;
+      const pid_t pid = wait (&waitStatus);
+      if (pid < 0) {
+         if (errno == EINTR) continue;
+         perror ("wait");
+         break;
+      }
+
+      for (int j = 0; j < started; j++) {
+         const TestCase& testCase = cases [j];
+         if (testCase.pid != pid) continue;
+
+         running--;
+         printf ("case %d: %s -> %s: ", j + 1, testCase.input.c_str(), testCase.output.c_str());
+         if (WIFEXITED (waitStatus) && (WEXITSTATUS (waitStatus) < ARRAY_LENGTH (outcomes))) {
+            const int status = WEXITSTATUS (waitStatus);
+            if (status == batchStopped) completed++;
+            printf ("%s\n", outcomes [status]);
+         } else if (WIFSIGNALED (waitStatus)) {
+            printf ("killed by signal %d\n", WTERMSIG (waitStatus));
+         } else {
+            printf ("exit status %d\n", WEXITSTATUS (waitStatus));
+         }
+         break;
+      }
+   }
+
+   sigIntReceived = false;
+   printf ("%d of %d cases run, %d completed\n", started, numberCases, completed);
+}
+
+//------------------------------------------------------------------------------
+// Enables or disables opcode counting on all processors.
+//
+static void setOpcodeCounting (Session& session, const bool enable)
+{
+   for (int j = 0; j < session.processorCount; j++) {
+      session.processorList [j]->setOpcodeCounting (enable);
+   }
+}
+
+//------------------------------------------------------------------------------
+// Lists the opcode histogram of each processor that is counting.
+//
+static void opcodeHistograms (Session& session)
+{
+   L16E::Diagnostics* const diagnostics = session.machine->getDiagnostics();
+
+   bool isCounting = false;
+   for (int j = 0; j < session.processorCount; j++) {
+      L16E::ALP_Processor* processor = session.processorList [j];
+      const uint64_t* counts = processor->getOpcodeCounts();
+      if (!counts) continue;
+
+      printf ("%s opcode histogram\n", processor->getName());
+      diagnostics->opcodeHistogram (counts);
+      isCounting = true;
+   }
+
+   if (!isCounting) printf ("opcode counting is off\n");
+}
+
+//------------------------------------------------------------------------------
+// Enables or disables address counting on all processors.
+//
+static void setAddressCounting (Session& session, const bool enable)
+{
+   for (int j = 0; j < session.processorCount; j++) {
+      session.processorList [j]->setAddressCounting (enable);
+   }
+}
+
+//------------------------------------------------------------------------------
+// Lists the number hottest addresses of each processor that is counting.
+//
+static void hotSpots (Session& session, const int number)
+{
+   L16E::Diagnostics* const diagnostics = session.machine->getDiagnostics();
+
+   bool isCounting = false;
+   for (int j = 0; j < session.processorCount; j++) {
+      L16E::ALP_Processor* processor = session.processorList [j];
+      const uint64_t* counts = processor->getAddressCounts();
+      if (!counts) continue;
+
+      printf ("%s hot spots\n", processor->getName());
+      diagnostics->hotSpots (counts, number);
+      isCounting = true;
+   }
+
+   if (!isCounting) printf ("address counting is off\n");
+}
+
+//------------------------------------------------------------------------------
+// Writes the address counts of each processor that is counting to filename,
+// or for the second and subsequent processors, to filename.n
+//
+static void exportAddressCounts (Session& session, const std::string filename)
+{
+   L16E::Diagnostics* const diagnostics = session.machine->getDiagnostics();
+
+   bool isCounting = false;
+   for (int j = 0; j < session.processorCount; j++) {
+      L16E::ALP_Processor* processor = session.processorList [j];
+      const uint64_t* counts = processor->getAddressCounts();
+      if (!counts) continue;
+
+      const std::string name = isCounting ? filename + "." + std::to_string (j + 1) : filename;
+      if (diagnostics->exportAddressCounts (counts, name.c_str())) {
+         printf ("%s address counts written to %s\n", processor->getName(), name.c_str());
+      }
+      isCounting = true;
+   }
+
+   if (!isCounting) printf ("address counting is off\n");
+}
+
+//------------------------------------------------------------------------------
+// Starts tracing each processor to filename or, for the second and subsequent
+// processors, to filename.n
+//
+static bool startTrace (Session& session, const std::string filename, const int capacity)
+{
+   bool status = true;
+   for (int j = 0; j < session.processorCount; j++) {
+      L16E::ALP_Processor* processor = session.processorList [j];
+      const std::string name = (j > 0) ? filename + "." + std::to_string (j + 1) : filename;
+      if (processor->startTrace (name, capacity)) {
+         printf ("%s tracing to %s\n", processor->getName(), name.c_str());
+      } else {
+         status = false;
+      }
+   }
+   return status;
+}
+
+//------------------------------------------------------------------------------
+//
+static void stopTrace (Session& session)
+{
+   for (int j = 0; j < session.processorCount; j++) {
+      session.processorList [j]->stopTrace();
+   }
+}
+
+//------------------------------------------------------------------------------
+// Headless batch mode. Runs from the current state, without any user
+// interaction, as per runUntilStopped. Prints the final registers and the
+// execution rate, and returns the process exit status (see execute.h).
+//
+static int runBatch (Session& session, const int64_t maxInstructions)
+{
+   struct timespec startTime;
+   struct timespec endTime;
+   clock_gettime (CLOCK_MONOTONIC, &startTime);
+
+   int64_t total;
+   const char* reason;
+   const int result = runUntilStopped (session, maxInstructions, total, reason);
+
+   clock_gettime (CLOCK_MONOTONIC, &endTime);
+   const double seconds = (endTime.tv_sec - startTime.tv_sec) +
+                          1.0e-9 * (endTime.tv_nsec - startTime.tv_nsec);
+
+   std::cout << std::endl;
+   for (int j = 0; j < session.processorCount; j++) {
+      session.processorList [j]->dumpRegisters();
+   }
+
+   printf ("stopped: %s\n", reason);
+   printf ("instructions: %ld\n", long (total));
+   printf ("seconds: %.3f\n", seconds);
+   printf ("instructions/second: %.0f\n", seconds > 0.0 ? total / seconds : 0.0);
+
+   for (int j = 0; j < session.processorCount; j++) {
+      if (session.processorList [j]->getOpcodeCounts()) {
+         opcodeHistograms (session);
+         break;
+      }
+   }
+
+   for (int j = 0; j < session.processorCount; j++) {
+      if (session.processorList [j]->getAddressCounts()) {
+         hotSpots (session, defaultHotSpots);
+         break;
+      }
+   }
+   return result;
+}
+
+//------------------------------------------------------------------------------
+//
+int run (const RunOptions& options)
+{
+   bool status;
+   L16E::Machine* const machine = new L16E::Machine();
+   L16E::DataBus* const dataBus = machine->getDataBus();
+   L16E::Diagnostics* const diagnostics = machine->getDiagnostics();
+
+   status = machine->configure (options.iniFile);
+   if (!status) {
+      delete machine;
+      return batchSetupFailed;
+   }
+
+   Session session;
+   session.machine = machine;
+   session.activeDevice = 0;
+   session.fastForward = options.fastForward;
+   session.stopWhenBlocked = options.batch;
+   session.untilAddress = options.untilAddress;
 
    // Get a list of all the active devices, e.g. ALP processors, DMA devices etc.
    //
-   const int activeCount = dataBus->getActiveDevices (activeDeviceList,
-                                                      ARRAY_LENGTH(activeDeviceList));
+   const int activeCount = dataBus->getActiveDevices (session.activeDeviceList,
+                                                      ARRAY_LENGTH(session.activeDeviceList));
+   session.activeCount = activeCount;
 
    printf ("Number of active devices: %d\n", activeCount);
    if (activeCount <= 0) {
       printf ("Incomplete crate - no active devices\n");
-      return 2;
+      delete machine;
+      return batchSetupFailed;
    }
+
    std::cout << std::endl;
 
-   // Load program file "tape" into the tape reader.
+   // Load the program and output tapes, and initialise peripherals and devices.
+   // In batch mode there is no one to use an xterm.
    //
-   L16E::TapeReader* reader = findPeripheral<L16E::TapeReader>();
-   if (reader) {
-      reader->setFilename (programFile);
+   machine->setHeadless (options.batch);
+   status = machine->initialise (options.programFile, options.outputFile);
+   if (!status) {
+      delete machine;
+      return batchSetupFailed;
    }
 
-   L16E::TapePunch* punch  = findPeripheral<L16E::TapePunch>();
-   if (punch) {
-      punch->setFilename (outputFile);
-   }
+   // The clock, if any, is found on initialisation.
+   //
+   L16E::Clock* const clock = machine->getClock();
+   session.pacer.setCycleDuration (clock ? clock->cycleDuration() : nominalCycleDuration);
+   session.pacer.setSpeed (options.speed);
 
-   // Initialise peripherals and devices.
+   // Restore the snapshot, if any, in place of the initial state.
    //
-   status = L16E::Peripheral::initialisePeripherals();
-   if (!status) return 4;
-   status = dataBus->initialiseDevices();
-   if (!status) return 4;
+   if (!options.loadFile.empty()) {
+      status = L16E::Snapshot::restore (options.loadFile, machine);
+      if (!status) {
+         delete machine;
+         return batchSetupFailed;
+      }
+   }
 
-   L16E::ALP_Processor* processor1 = findDevice <L16E::ALP_Processor> (dataBus, 1);
-   L16E::ALP_Processor* processor2 = findDevice <L16E::ALP_Processor> (dataBus, 2);
-   L16E::MemoryMapper* mapper = findDevice <L16E::MemoryMapper> (dataBus);
-   L16E::Clock* clock = findDevice <L16E::Clock> (dataBus);;
+   L16E::ALP_Processor* processor1 = machine->getProcessor (1);
+   L16E::ALP_Processor* processor2 = machine->getProcessor (2);
+   if (processor1) {
+      processor1->setEngine (options.engine);
+      processor1->setFastForward (options.fastForward);
+   }
+   if (processor2) {
+      processor2->setEngine (options.engine);
+      processor2->setFastForward (options.fastForward);
+   }
 
    // Catch interrupts to allow the emulator to escape program execution and
    // enter into diagnostic mode.
@@ -168,13 +1208,42 @@ int run (const std::string iniFile,
 
    std::cout << std::endl;
 
+   // Parallel mode requires that all active devices be ALP processors.
+   //
+   session.processorCount = 0;
+   for (int d = 0; d < activeCount; d++) {
+      L16E::ALP_Processor* processor = dynamic_cast <L16E::ALP_Processor*> (session.activeDeviceList [d]);
+      if (processor) session.processorList [session.processorCount++] = processor;
+   }
+
+   session.runInParallel = options.parallel && (session.processorCount == activeCount);
+   if (options.parallel && !session.runInParallel) {
+      printf ("Not all active devices are ALP processors - parallel mode ignored\n");
+   }
+
+   if (options.opcodeCounting) setOpcodeCounting (session, true);
+   if (options.addressCounting) setAddressCounting (session, true);
+
+   if (!options.traceFile.empty() && !startTrace (session, options.traceFile, defaultTraceCapacity)) {
+      delete machine;
+      return batchSetupFailed;
+   }
+
+   if (options.batch) {
+      const int result = runBatch (session, options.maxInstructions);
+      if (!options.saveFile.empty()) {
+         L16E::Snapshot::save (options.saveFile, machine);
+      }
+      delete machine;
+      return result;
+   }
+
    if (processor1) processor1->dumpRegisters();
    if (processor2) processor2->dumpRegisters();
 
    char* lastLine = nullptr;
    char* thisLine = nullptr;
 
-   int activeDevice = 0;
    while (true) {
       thisLine = readline ("> ");
       if (!thisLine) {
@@ -242,70 +1311,9 @@ int run (const std::string iniFile,
             }
          }
 
-         /// -------------------------------------------------------------------
-         // Round robin all active devices.
-         // I did think about a separate thread for each active device, however
-         // the use of mutex prob. negates the benefit of multiple threads.
-         //
          sigIntReceived = false;
-         for (int64_t ic = 0; ic < number; ic++) {
-            // First check for any user command-line interrupt.
-            //
-            if (sigIntReceived) {
-               sigIntReceived = false;
-               break;
-            }
-
-            // Do the round-robin update and select the active device.
-            //
-            activeDevice = (activeDevice + 1) % activeCount;
-            L16E::DataBus::ActiveDevice* device = activeDeviceList [activeDevice];
-            L16E::ALP_Processor* processor = dynamic_cast <L16E::ALP_Processor*> (device);
-
-            // Let memory mapper controller know who is (or will be)
-            // trying to access memory.
-            //
-            int id = device->getActiveIdentity();
-            if (mapper) mapper->setActiveIdentity(id);
-
-            // Check for break points.
-            //
-            if ((ic > 0) && processor) {
-               Int16 next = processor->getPreg();
-               if (diagnostics->isBreakPoint(next)) {
-                  // At a break point
-                  std::cout << "break point " << device->getName() << std::endl;
-                  break;
-               }
-            }
-
-            // Only primary ALP gets interrupted by the clock.
-            //
-            if (clock && clock->testAndClearInterruptPending()) {
-               if (processor1) processor1->requestInterrupt();
-            }
-
-            bool status = device->execute();
-
-            // This slows the emulator down to approximatley real-time
-            // At least on my setup at home.
-            //
-            if ((ic % sleepModulo) == 0) usleep (1);
-
-            // Let clock know we have executed one instruction.
-            // This adds 2.25 or 1.68 uSec to the amount of time that has passed.
-            // (based on the number of active/ALP process in the crate).
-            //
-            if (clock) clock->executeCycle ();
-
-            if (!status) {
-               // The device reports the error.
-               if (processor) diagnostics->accessAddress(processor->getPreg() - 2);
-               break;
-            }
-         }
-         //
-         /// -------------------------------------------------------------------
+         int64_t executed;
+         runSession (session, number, executed);
 
          if (processor1) {
             processor1->dumpRegisters();
@@ -395,12 +1403,30 @@ int run (const std::string iniFile,
          // Set break
          int n;
          unsigned uaddr = 0;
+         int length = 0;
+         std::string conditionText;
+         int64_t count;
 
-         n = sscanf(start + 2, "%x", &uaddr);
-         if (n == 1) {
-            // Set break point.
+         n = sscanf(start + 2, "%x%n", &uaddr, &length);
+         if ((n == 1) && parseBreakOptions (start + 2 + length, conditionText, count)) {
             const Int16 addr = Int16 (uaddr);
-            diagnostics->setBreak (addr);
+            if (conditionText.empty() && (count == 1)) {
+               // Set break point.
+               diagnostics->setBreak (addr);
+            } else {
+               // Set conditional and/or counted break point, the condition
+               // compiled once here.
+               std::string error;
+               L16E::BreakCondition* condition = nullptr;
+               if (!conditionText.empty()) {
+                  condition = L16E::BreakCondition::compile (conditionText, error);
+               }
+               if (condition || conditionText.empty()) {
+                  diagnostics->setBreak (addr, condition, count);
+               } else {
+                  std::cout << "Invalid condition: " << error << std::endl;
+               }
+            }
          } else {
             std::cout << "Invalid:" << start << std::endl;
          }
@@ -418,10 +1444,161 @@ int run (const std::string iniFile,
             std::cout << "Invalid:" << start << std::endl;
          }
 
+      } else if (startsWith(start, "SW")) {
+         // Set watch
+         int n;
+         unsigned uaddr = 0;
+         char text [40] = "RW";
+
+         n = sscanf(start + 2, "%x %39s", &uaddr, text);
+         int kinds = 0;
+         if (strcasecmp (text, "R") == 0) {
+            kinds = L16E::DataBus::watchRead;
+         } else if (strcasecmp (text, "W") == 0) {
+            kinds = L16E::DataBus::watchWrite;
+         } else if (strcasecmp (text, "RW") == 0) {
+            kinds = L16E::DataBus::watchRead | L16E::DataBus::watchWrite;
+         }
+
+         if ((n >= 1) && (kinds != 0)) {
+            const Int16 addr = Int16 (uaddr);
+            diagnostics->setWatch (addr, kinds);
+         } else {
+            std::cout << "Invalid:" << start << std::endl;
+         }
+
+      } else if (startsWith(start, "CW")) {
+         // Clear watch
+         int n;
+         unsigned uaddr = 0;
+
+         n = sscanf(start + 2, "%x", &uaddr);
+         if (n == 1) {
+            const Int16 addr = Int16 (uaddr);
+            diagnostics->clearWatch (addr);
+         } else {
+            std::cout << "Invalid:" << start << std::endl;
+         }
+
+      } else if (startsWith (start, "SAVE") || startsWith (start, "LOAD")) {
+         // Save/load snapshot
+         const char* filename = start + 4;
+         while (isspace (int (*filename))) filename++;
+
+         if (*filename == '\0') {
+            std::cout << "Invalid: " << start << std::endl;
+         } else if (startsWith (start, "SAVE")) {
+            if (L16E::Snapshot::save (filename, machine)) {
+               std::cout << "saved " << filename << std::endl;
+            }
+         } else {
+            if (L16E::Snapshot::restore (filename, machine)) {
+               std::cout << "loaded " << filename << std::endl;
+               if (processor1) processor1->dumpRegisters();
+               if (processor2) processor2->dumpRegisters();
+            } else {
+               std::cout << "load failed" << std::endl;
+            }
+         }
+
+      } else if (startsWith (start, "TC")) {
+         // Run test cases
+         int n;
+         char caseFile [256];
+         int64_t number = 0;
+
+         n = sscanf(start + 2, "%255s %ld", caseFile, &number);
+         if ((n == 2) && (number > 0)) {
+            runTestCases (session, caseFile, number);
+         } else {
+            std::cout << "Invalid: " << start << std::endl;
+         }
+
+      } else if (startsWith (start, "OH")) {
+         // Opcode histogram
+         char text [40];
+
+         const int n = sscanf(start + 2, "%39s", text);
+         if (n < 1) {
+            opcodeHistograms (session);
+         } else if (strcasecmp (text, "ON") == 0) {
+            setOpcodeCounting (session, true);
+         } else if (strcasecmp (text, "OFF") == 0) {
+            setOpcodeCounting (session, false);
+         } else {
+            std::cout << "Invalid: " << start << std::endl;
+         }
+
+      } else if (startsWith (start, "HS")) {
+         // Hot spots
+         char text [40];
+         char filename [256];
+         int number = defaultHotSpots;
+
+         const int n = sscanf(start + 2, "%39s", text);
+         if (n < 1) {
+            hotSpots (session, number);
+         } else if (strcasecmp (text, "ON") == 0) {
+            setAddressCounting (session, true);
+         } else if (strcasecmp (text, "OFF") == 0) {
+            setAddressCounting (session, false);
+         } else if (strcasecmp (text, "EXPORT") == 0) {
+            if (sscanf(start + 2, "%39s %255s", text, filename) == 2) {
+               exportAddressCounts (session, filename);
+            } else {
+               std::cout << "Invalid: " << start << std::endl;
+            }
+         } else if ((sscanf (text, "%d", &number) == 1) && (number > 0)) {
+            hotSpots (session, number);
+         } else {
+            std::cout << "Invalid: " << start << std::endl;
+         }
+
+      } else if (startsWith (start, "TR")) {
+         // Trace
+         char filename [256];
+         int capacity = defaultTraceCapacity;
+
+         const int n = sscanf(start + 2, "%255s %d", filename, &capacity);
+         if ((n >= 1) && (strcasecmp (filename, "OFF") == 0)) {
+            stopTrace (session);
+         } else if ((n >= 1) && (capacity > 0)) {
+            startTrace (session, filename, capacity);
+         } else {
+            std::cout << "Invalid: " << start << std::endl;
+         }
+
+      } else if (startsWith (start, "SP")) {
+         // Speed
+         char text [40];
+         double speed = 0.0;
+
+         const int n = sscanf(start + 2, "%39s", text);
+         if (n < 1) {
+            // Just show the current speed.
+         } else if (strcasecmp (text, "MAX") == 0) {
+            session.pacer.setSpeed (0.0);
+         } else if ((sscanf (text, "%lf", &speed) == 1) && (speed > 0.0)) {
+            session.pacer.setSpeed (speed);
+         } else {
+            std::cout << "Invalid: " << start << std::endl;
+         }
+
+         speed = session.pacer.getSpeed();
+         if (speed > 0.0) {
+            printf ("speed: %g x real time\n", speed);
+         } else {
+            printf ("speed: unthrottled\n");
+         }
+
       } else if (startsWith (start, "LB")) {
          // List breaks
          diagnostics->listBreaks();
 
+      } else if (startsWith (start, "LW")) {
+         // List watches
+         diagnostics->listWatches();
+
       } else if (startsWith (start, "HE")) {
          // Help
          const char* hlp;
@@ -433,8 +1610,35 @@ int run (const std::string iniFile,
                "SC hexaddr hexvalues set upto 16 values from the specified start address\n"
                "DR [level]           dump ALP registers for current or specified level\n"
                "SB hexaddr           set break point\n"
+               "SB hexaddr [if condition] [count number]\n"
+               "                     set break point that only stops when the condition, e.g.\n"
+               "                     A==0 && level==1, is true, and then only every number\n"
+               "                     times. Condition operands: A R S T P LEVEL C V K, and\n"
+               "                     decimal or 0x hex numbers. Operators: ! - + & == != <\n"
+               "                     <= > >= && || and parentheses\n"
                "CB hexaddr           clear break point\n"
                "LB                   list break points\n"
+               "SW hexaddr [R|W|RW]  set watch point on reads and/or writes (default RW) of\n"
+               "                     the word at hexaddr - not the I/O page\n"
+               "CW hexaddr           clear watch point\n"
+               "LW                   list watch points\n"
+               "SAVE filename        save machine snapshot\n"
+               "LOAD filename        load machine snapshot\n"
+               "TC file number       run each test case (input and output tape file) listed\n"
+               "                     in file from the current state, unthrottled, until halted\n"
+               "                     or end of input, upto number instructions\n"
+               "OH [ON|OFF]          list the opcode histogram, or start (from zero) or\n"
+               "                     stop counting opcodes, which disables the block engines\n"
+               "HS [number]          list the number (default 20) most executed addresses\n"
+               "HS ON|OFF            start (from zero) or stop counting instructions per\n"
+               "                     address, which disables the block engines\n"
+               "HS EXPORT filename   write the address counts to file as CSV\n"
+               "TR filename [number] trace each instruction executed to a ring buffer of the\n"
+               "                     last number (default 1M) records in filename, which\n"
+               "                     disables the block engines - see locus16_trace\n"
+               "TR OFF               stop tracing\n"
+               "SP [factor|MAX]      set speed to factor times real time, or unthrottled\n"
+               "                     (MAX), or show the speed\n"
                "HE                   help\n"
                "// <any text>        comment - ignored.\n";
 
@@ -450,6 +1654,12 @@ int run (const std::string iniFile,
       thisLine = nullptr;
    }
 
+   if (!options.saveFile.empty()) {
+      L16E::Snapshot::save (options.saveFile, machine);
+   }
+
+   delete machine;
+
    printf ("complete\n");
    return 0;
 }
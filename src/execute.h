@@ -12,11 +12,41 @@
 #ifndef L16E_EXECUTE_H
 #define L16E_EXECUTE_H
 
+#include <stdint.h>
 #include <string>
+#include "alp_processor.h"
 
-int run (const std::string iniFile,
-         const std::string programFile,
-         const std::string outputFile,
-         const int sleepModulo);
+// Exit statuses. batchSetupFailed applies in interactive mode too, otherwise
+// interactive mode returns 0.
+//
+enum BatchStatus {
+   batchStopped = 0,           // until address reached, halted or end of input
+   batchBudgetExhausted = 1,   // maximum number of instructions executed
+   batchFailed = 2,            // e.g. undefined instruction
+   batchInterrupted = 3,       // SIGINT
+   batchSetupFailed = 4        // e.g. configuration or program file error
+};
+
+// Run options, as per the command line.
+//
+struct RunOptions {
+   std::string iniFile;
+   std::string programFile;
+   std::string outputFile;
+   L16E::ALP_Processor::Engines engine;
+   bool fastForward;
+   double speed;              // emulated time per real time, 0.0 for unthrottled
+   bool parallel;
+   bool opcodeCounting;
+   bool addressCounting;
+   std::string traceFile;     // empty for none, likewise loadFile and saveFile
+   std::string loadFile;
+   std::string saveFile;
+   bool batch;                // run immediately without user interaction
+   int64_t maxInstructions;   // batch mode only
+   int untilAddress;          // batch mode only, -1 for none
+};
+
+int run (const RunOptions& options);
 
 #endif // L16E_EXECUTE_H
@@ -0,0 +1,135 @@
+/* io_request_queue.cpp
+ *
+ * This file is part of the Locus 16 Emulator application.
+ *
+ * SPDX-FileCopyrightText: 2021-2025  Andrew C. Starritt
+ * SPDX-License-Identifier: LGPL-3.0-only
+ *
+ * Contact details:
+ * andrew.starritt@gmail.com
+ */
+
+#include "io_request_queue.h"
+#include <sched.h>
+#include "data_bus.h"
+#include "memory.h"
+
+using namespace L16E;
+
+//------------------------------------------------------------------------------
+//
+IoRequestQueue::IoRequestQueue (DataBus* const dataBusIn,
+                                MemoryMapper* const mapperIn,
+                                const int activeIdentityIn) :
+   dataBus (dataBusIn),
+   mapper (mapperIn),
+   activeIdentity (activeIdentityIn),
+   kind (getWordKind),
+   addr (0),
+   value (0),
+   fd (-1),
+   state (idle)
+{
+}
+
+//------------------------------------------------------------------------------
+//
+IoRequestQueue::~IoRequestQueue () { }
+
+//------------------------------------------------------------------------------
+//
+Int16 IoRequestQueue::getWord (const Int16 addr)
+{
+   return this->request (getWordKind, addr, 0);
+}
+
+//------------------------------------------------------------------------------
+//
+UInt8 IoRequestQueue::getByte (const Int16 addr)
+{
+   return UInt8 (this->request (getByteKind, addr, 0));
+}
+
+//------------------------------------------------------------------------------
+//
+void IoRequestQueue::setWord (const Int16 addr, const Int16 value)
+{
+   this->request (setWordKind, addr, value);
+}
+
+//------------------------------------------------------------------------------
+//
+void IoRequestQueue::setByte (const Int16 addr, const UInt8 value)
+{
+   this->request (setByteKind, addr, value);
+}
+
+//------------------------------------------------------------------------------
+//
+bool IoRequestQueue::isIdlePoll (const Int16 addr, int& fd)
+{
+   const bool result = (this->request (isIdlePollKind, addr, 0) != 0);
+   fd = this->fd;
+   return result;
+}
+
+//------------------------------------------------------------------------------
+//
+Int16 IoRequestQueue::request (const Kinds kind, const Int16 addr, const Int16 value)
+{
+   this->kind = kind;
+   this->addr = addr;
+   this->value = value;
+   this->state.store (requested, std::memory_order_release);
+
+   // Device accesses are rare compared with instructions, and the main thread
+   // does little else but service requests, so a short spin is worthwhile.
+   //
+   int spin = 0;
+   while (this->state.load (std::memory_order_acquire) != serviced) {
+      if (++spin >= 1000) {
+         spin = 0;
+         sched_yield ();
+      }
+   }
+
+   const Int16 result = this->value;
+   this->state.store (idle, std::memory_order_relaxed);
+   return result;
+}
+
+//------------------------------------------------------------------------------
+//
+bool IoRequestQueue::service ()
+{
+   if (this->state.load (std::memory_order_acquire) != requested) return false;
+
+   if (this->mapper) this->mapper->setActiveIdentity (this->activeIdentity);
+
+   switch (this->kind) {
+      case getWordKind:
+         this->value = this->dataBus->getWord (this->addr);
+         break;
+
+      case getByteKind:
+         this->value = this->dataBus->getByte (this->addr);
+         break;
+
+      case setWordKind:
+         this->dataBus->setWord (this->addr, this->value);
+         break;
+
+      case setByteKind:
+         this->dataBus->setByte (this->addr, UInt8 (this->value));
+         break;
+
+      case isIdlePollKind:
+         this->value = this->dataBus->isIdlePoll (this->addr, this->fd) ? 1 : 0;
+         break;
+   }
+
+   this->state.store (serviced, std::memory_order_release);
+   return true;
+}
+
+// end
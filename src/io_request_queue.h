@@ -0,0 +1,82 @@
+/* io_request_queue.h
+ *
+ * This file is part of the Locus 16 Emulator application.
+ *
+ * SPDX-FileCopyrightText: 2021-2025  Andrew C. Starritt
+ * SPDX-License-Identifier: LGPL-3.0-only
+ *
+ * Contact details:
+ * andrew.starritt@gmail.com
+ */
+
+#ifndef L16E_IO_REQUEST_QUEUE_H
+#define L16E_IO_REQUEST_QUEUE_H
+
+#include <atomic>
+#include "locus16_common.h"
+
+namespace L16E {
+
+class DataBus;
+class MemoryMapper;
+
+// Passes the data bus accesses of an active device running on its own host
+// thread to the main thread, which performs them on the device's behalf.
+// This serialises all device (as opposed to host memory page) accesses
+// without any locks.
+//
+// The queue holds one request at a time: the active device thread posts a
+// request and then waits until the main thread has serviced it, so that
+// read and write ordering is exactly as in the single threaded case.
+//
+class IoRequestQueue {
+public:
+   // The mapper (if any) is told the active identity before each access.
+   //
+   explicit IoRequestQueue (DataBus* const dataBus,
+                            MemoryMapper* const mapper,
+                            const int activeIdentity);
+   ~IoRequestQueue ();
+
+   // Called by the active device thread - these wait until serviced.
+   //
+   Int16 getWord (const Int16 addr);
+   UInt8 getByte (const Int16 addr);
+   void setWord (const Int16 addr, const Int16 value);
+   void setByte (const Int16 addr, const UInt8 value);
+
+   // As per DataBus::isIdlePoll.
+   //
+   bool isIdlePoll (const Int16 addr, int& fd);
+
+   // Called by the main thread. Performs the pending request, if any, and
+   // returns true if there was a request.
+   //
+   bool service ();
+
+private:
+   enum Kinds { getWordKind, getByteKind, setWordKind, setByteKind, isIdlePollKind };
+   enum States { idle, requested, serviced };
+
+   // Posts the request and waits for the main thread, returning the value.
+   //
+   Int16 request (const Kinds kind, const Int16 addr, const Int16 value);
+
+   DataBus* const dataBus;
+   MemoryMapper* const mapper;
+   const int activeIdentity;
+
+   // Only accessed by the thread that currently owns the request, as given
+   // by the state.
+   //
+   Kinds kind;
+   Int16 addr;
+   Int16 value;
+   int fd;         // isIdlePoll only
+
+   std::atomic <int> state;
+};
+
+}
+
+#endif // L16E_IO_REQUEST_QUEUE_H
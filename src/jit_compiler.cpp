@@ -0,0 +1,785 @@
+/* jit_compiler.cpp
+ *
+ * This file is part of the Locus 16 Emulator application.
+ *
+ * SPDX-FileCopyrightText: 2021-2025  Andrew C. Starritt
+ * SPDX-License-Identifier: LGPL-3.0-only
+ *
+ * Contact details:
+ * andrew.starritt@gmail.com
+ */
+
+#include "jit_compiler.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define L16E_NATIVE_X86_64
+#include <sys/mman.h>
+#endif
+
+using namespace L16E;
+
+#ifdef L16E_NATIVE_X86_64
+
+//------------------------------------------------------------------------------
+// A minimal x86-64 code emitter - just the instructions we need.
+//------------------------------------------------------------------------------
+//
+// Host registers
+//
+enum HostRegisters {
+   RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+   R12 = 12, R13 = 13, R14 = 14, R15 = 15
+};
+
+// Condition codes
+//
+enum Conditions {
+   ccE = 0x4, ccNE = 0x5, ccL = 0xC, ccGE = 0xD
+};
+
+// ALU op codes (op r/m32, r32) and the corresponding /digit for immediates.
+//
+enum AluOps {
+   aluAdd = 0x01, aluOr = 0x09, aluAnd = 0x21, aluSub = 0x29,
+   aluXor = 0x31, aluCmp = 0x39, aluMov = 0x89
+};
+
+class Emitter {
+public:
+   explicit Emitter (unsigned char* start) : p (start) { }
+
+   unsigned char* p;
+
+   void byte (const int x) { *p++ = x; }
+
+   void dword (const int x) {
+      const uint32_t v = x;
+      memcpy (p, &v, 4);
+      p += 4;
+   }
+
+   void qword (const uint64_t x) {
+      memcpy (p, &x, 8);
+      p += 8;
+   }
+
+   void rex (const bool w, const int reg, const int index, const int base) {
+      const int r = 0x40 | (w ? 8 : 0) | ((reg & 8) ? 4 : 0) |
+                    ((index & 8) ? 2 : 0) | ((base & 8) ? 1 : 0);
+      if (r != 0x40) this->byte (r);
+   }
+
+   // [base + disp32]
+   //
+   void memory (const int reg, const int base, const int disp) {
+      this->byte (0x80 | ((reg & 7) << 3) | (base & 7));
+      if ((base & 7) == RSP) this->byte (0x24);
+      this->dword (disp);
+   }
+
+   // [base + index] - base must not be RBP/R13.
+   //
+   void indexed (const int reg, const int base, const int index) {
+      this->byte (0x04 | ((reg & 7) << 3));
+      this->byte (((index & 7) << 3) | (base & 7));
+   }
+
+   void registers (const int reg, const int rm) {
+      this->byte (0xC0 | ((reg & 7) << 3) | (rm & 7));
+   }
+
+   // 32 bit register to register ALU operations, dst op= src
+   //
+   void alu (const AluOps op, const int dst, const int src) {
+      this->rex (false, src, 0, dst);
+      this->byte (op);
+      this->registers (src, dst);
+   }
+
+   void aluImmediate (const AluOps op, const int dst, const int imm) {
+      const int digit = (op == aluMov) ? -1 : (op >> 3);
+      if (digit < 0) {
+         this->rex (false, 0, 0, dst);
+         this->byte (0xB8 + (dst & 7));
+         this->dword (imm);
+         return;
+      }
+      this->rex (false, 0, 0, dst);
+      this->byte (0x81);
+      this->registers (digit, dst);
+      this->dword (imm);
+   }
+
+   void mov64 (const int dst, const int src) {
+      this->rex (true, src, 0, dst);
+      this->byte (0x89);
+      this->registers (src, dst);
+   }
+
+   void signExtend16 (const int dst, const int src) {       // movsx r32, r16
+      this->rex (false, dst, 0, src);
+      this->byte (0x0F);
+      this->byte (0xBF);
+      this->registers (dst, src);
+   }
+
+   void shift (const int digit, const int reg, const int n) {   // 4 shl, 5 shr, 7 sar
+      this->rex (false, 0, 0, reg);
+      this->byte (0xC1);
+      this->registers (digit, reg);
+      this->byte (n);
+   }
+
+   void swapBytes16 (const int reg) {                          // rol r16, 8
+      this->byte (0x66);
+      this->rex (false, 0, 0, reg);
+      this->byte (0xC1);
+      this->registers (0, reg);
+      this->byte (8);
+   }
+
+   void multiply (const int dst, const int src) {              // imul r32, r32
+      this->rex (false, dst, 0, src);
+      this->byte (0x0F);
+      this->byte (0xAF);
+      this->registers (dst, src);
+   }
+
+   void load16SignExtend (const int dst, const int base, const int disp) {
+      this->rex (false, dst, 0, base);
+      this->byte (0x0F);
+      this->byte (0xBF);
+      this->memory (dst, base, disp);
+   }
+
+   void load32 (const int dst, const int base, const int disp) {
+      this->rex (false, dst, 0, base);
+      this->byte (0x8B);
+      this->memory (dst, base, disp);
+   }
+
+   void load64 (const int dst, const int base, const int disp) {
+      this->rex (true, dst, 0, base);
+      this->byte (0x8B);
+      this->memory (dst, base, disp);
+   }
+
+   void load64Indexed (const int dst, const int base, const int index, const int disp) {
+      this->rex (true, dst, index, base);
+      this->byte (0x8B);
+      this->byte (0x84 | ((dst & 7) << 3));
+      this->byte (((index & 7) << 3) | (base & 7));
+      this->dword (disp);
+   }
+
+   // movzx r32, byte/word [base + disp32]
+   //
+   void loadZeroExtend (const bool isWord, const int dst, const int base, const int disp) {
+      this->rex (false, dst, 0, base);
+      this->byte (0x0F);
+      this->byte (isWord ? 0xB7 : 0xB6);
+      this->memory (dst, base, disp);
+   }
+
+   // movzx r32, byte/word [base + index]
+   //
+   void loadZeroExtendIndexed (const bool isWord, const int dst, const int base, const int index) {
+      this->rex (false, dst, index, base);
+      this->byte (0x0F);
+      this->byte (isWord ? 0xB7 : 0xB6);
+      this->indexed (dst, base, index);
+   }
+
+   // mov byte/word [base + disp32], src - src must be RAX .. RBX for bytes.
+   //
+   void store (const bool isWord, const int src, const int base, const int disp) {
+      if (isWord) this->byte (0x66);
+      this->rex (false, src, 0, base);
+      this->byte (isWord ? 0x89 : 0x88);
+      this->memory (src, base, disp);
+   }
+
+   void storeIndexed (const bool isWord, const int src, const int base, const int index) {
+      if (isWord) this->byte (0x66);
+      this->rex (false, src, index, base);
+      this->byte (isWord ? 0x89 : 0x88);
+      this->indexed (src, base, index);
+   }
+
+   void store32 (const int src, const int base, const int disp) {
+      this->rex (false, src, 0, base);
+      this->byte (0x89);
+      this->memory (src, base, disp);
+   }
+
+   void store16Immediate (const int base, const int disp, const int imm) {
+      this->byte (0x66);
+      this->rex (false, 0, 0, base);
+      this->byte (0xC7);
+      this->memory (0, base, disp);
+      this->byte (imm & 0xFF);
+      this->byte ((imm >> 8) & 0xFF);
+   }
+
+   void store32Immediate (const int base, const int disp, const int imm) {
+      this->rex (false, 0, 0, base);
+      this->byte (0xC7);
+      this->memory (0, base, disp);
+      this->dword (imm);
+   }
+
+   void test64 (const int reg) {
+      this->rex (true, reg, 0, reg);
+      this->byte (0x85);
+      this->registers (reg, reg);
+   }
+
+   void testEaxImmediate (const int imm) {
+      this->byte (0xA9);
+      this->dword (imm);
+   }
+
+   void compareByteImmediate (const int base, const int disp, const int imm) {
+      this->rex (false, 0, 0, base);
+      this->byte (0x80);
+      this->memory (7, base, disp);
+      this->byte (imm);
+   }
+
+   void push (const int reg) {
+      this->rex (false, 0, 0, reg);
+      this->byte (0x50 + (reg & 7));
+   }
+
+   void pop (const int reg) {
+      this->rex (false, 0, 0, reg);
+      this->byte (0x58 + (reg & 7));
+   }
+
+   void call (const void* function) {
+      this->byte (0x48);                  // mov rax, imm64
+      this->byte (0xB8);
+      this->qword (reinterpret_cast <uint64_t> (function));
+      this->byte (0xFF);                  // call rax
+      this->byte (0xD0);
+   }
+
+   void jump (const unsigned char* target) {
+      this->byte (0xE9);
+      this->dword (int (target - (this->p + 4)));
+   }
+
+   // Short forward conditional jump - returns the location to be patched.
+   //
+   unsigned char* jumpShortIf (const int condition) {
+      this->byte (0x70 + condition);
+      this->byte (0);
+      return this->p - 1;
+   }
+
+   void patchShort (unsigned char* location) {
+      *location = (unsigned char) (this->p - (location + 1));
+   }
+};
+
+
+//------------------------------------------------------------------------------
+// Block compilation
+//------------------------------------------------------------------------------
+//
+// Host registers for A, R, S and T - all callee saved.
+//
+static const int hostRegister [4] = { R12, R13, R14, R15 };
+
+enum IndexRegisters { indexP = 0, indexR = 1, indexS = 2, indexT = 3 };
+enum Registers { regA = 0, regR = 1, regS = 2, regT = 3 };
+
+//------------------------------------------------------------------------------
+//
+static int displacement (const void* base, const void* field)
+{
+   return int (reinterpret_cast <const char*> (field) -
+               reinterpret_cast <const char*> (base));
+}
+
+//------------------------------------------------------------------------------
+// Holds the per-block compilation context.
+//
+class JIT_Compiler::BlockCompiler {
+public:
+   BlockCompiler (ALP_Processor* processor, const unsigned int level,
+                  Emitter& emit, const void* notify) :
+      e (emit),
+      notify (notify)
+   {
+      const ALP_Processor::Registers* regs = &processor->registers [level];
+      this->dispP = displacement (processor, &regs->p);
+      this->dispRegister [regA] = displacement (processor, &regs->a);
+      this->dispRegister [regR] = displacement (processor, &regs->r);
+      this->dispRegister [regS] = displacement (processor, &regs->s);
+      this->dispRegister [regT] = displacement (processor, &regs->t);
+      this->dispKind = displacement (processor, &regs->triggerKind);
+      this->dispTriggerA = displacement (processor, &regs->triggerA);
+      this->dispTriggerB = displacement (processor, &regs->triggerB);
+      this->dispPageTable = displacement (processor, &processor->pageTable [0]);
+      this->dispStale = displacement (processor, &processor->blocksStale);
+   }
+
+   Emitter& e;
+   const void* const notify;
+   const unsigned char* epilogue;
+
+   int dispP;
+   int dispRegister [4];
+   int dispKind;
+   int dispTriggerA;
+   int dispTriggerB;
+   int dispPageTable;
+   int dispStale;
+
+   //---------------------------------------------------------------------------
+   // All exits set P (unless already set), the executed count and then go to
+   // the common epilogue that saves the host registers.
+   //
+   void exit (const Int16 nextP, const int count) {
+      this->e.store16Immediate (RBX, this->dispP, nextP);
+      this->exitKeepP (count);
+   }
+
+   void exitKeepP (const int count) {
+      this->e.aluImmediate (aluMov, RAX, count);
+      this->e.jump (this->epilogue);
+   }
+
+   // Page pointer null check - leave the instruction to the interpreter.
+   //
+   void sideExitIfNull (const Int16 address, const int count) {
+      this->e.test64 (RDX);
+      unsigned char* over = this->e.jumpShortIf (ccNE);
+      this->exit (address, count);
+      this->e.patchShort (over);
+   }
+
+   void emitPrologue () {
+      this->e.push (RBX);
+      this->e.push (RBP);
+      this->e.push (R12);
+      this->e.push (R13);
+      this->e.push (R14);
+      this->e.push (R15);
+      this->e.byte (0x48); this->e.byte (0x83); this->e.byte (0xEC); this->e.byte (0x08);  // sub rsp, 8
+      this->e.mov64 (RBX, RDI);
+      for (int r = 0; r < 4; r++) {
+         this->e.load16SignExtend (hostRegister [r], RBX, this->dispRegister [r]);
+      }
+   }
+
+   void emitEpilogue () {
+      for (int r = 0; r < 4; r++) {
+         this->e.store (true, hostRegister [r], RBX, this->dispRegister [r]);
+      }
+      this->e.byte (0x48); this->e.byte (0x83); this->e.byte (0xC4); this->e.byte (0x08);  // add rsp, 8
+      this->e.pop (R15);
+      this->e.pop (R14);
+      this->e.pop (R13);
+      this->e.pop (R12);
+      this->e.pop (RBP);
+      this->e.pop (RBX);
+      this->e.byte (0xC3);                                                                   // ret
+   }
+
+   //---------------------------------------------------------------------------
+   // Effective address, index register + offset. P relative addresses are
+   // known at compile time (P has already been incremented), otherwise the
+   // address is calculated into EAX (zero extended).
+   //
+   bool effectiveAddress (const int index, const ALP_Processor::Decoded& decoded,
+                          const Int16 address, Int16& constant) {
+      if (index == indexP) {
+         constant = Int16 (address + 2 + decoded.offset);
+         return true;
+      }
+      this->e.alu (aluMov, RAX, hostRegister [index]);
+      this->e.aluImmediate (aluAdd, RAX, decoded.offset);
+      this->e.aluImmediate (aluAnd, RAX, 0xFFFF);
+      return false;
+   }
+
+   // Loads the read or write page pointer into RDX, for address in EAX.
+   // Uses ECX.
+   //
+   void loadPage (const bool forWriting) {
+      const int offset = forWriting ? sizeof (UInt8*) : 0;
+      this->e.alu (aluMov, RCX, RAX);
+      this->e.shift (5, RCX, 12);                                 // shr
+      this->e.shift (4, RCX, 4);                                  // shl, i.e. * sizeof (Page)
+      this->e.load64Indexed (RDX, RBX, RCX, this->dispPageTable + offset);
+   }
+
+   void loadPage (const bool forWriting, const Int16 addr) {
+      const int offset = forWriting ? sizeof (UInt8*) : 0;
+      const int page = (addr >> 12) & 15;
+      this->e.load64 (RDX, RBX, this->dispPageTable + 16*page + offset);
+   }
+
+   //---------------------------------------------------------------------------
+   // Reads memory operand into ECX, word sign extended, byte zero extended.
+   //
+   void readOperand (const int index, const bool isWord,
+                     const ALP_Processor::Decoded& decoded,
+                     const Int16 address, const int count) {
+      const int mask = isWord ? 0x0FFE : 0x0FFF;
+      Int16 addr;
+      if (this->effectiveAddress (index, decoded, address, addr)) {
+         this->loadPage (false, addr);
+         this->sideExitIfNull (address, count);
+         this->e.loadZeroExtend (isWord, RCX, RDX, addr & mask);
+      } else {
+         this->loadPage (false);
+         this->sideExitIfNull (address, count);
+         this->e.aluImmediate (aluAnd, RAX, mask);
+         this->e.loadZeroExtendIndexed (isWord, RCX, RDX, RAX);
+      }
+
+      if (isWord) {
+         this->e.swapBytes16 (RCX);                // big endian
+         this->e.signExtend16 (RCX, RCX);
+      }
+   }
+
+   //---------------------------------------------------------------------------
+   // Writes register to memory, then notifies the modification, exiting if
+   // this makes the translated blocks stale.
+   //
+   void writeOperand (const int reg, const int index, const bool isWord,
+                      const ALP_Processor::Decoded& decoded,
+                      const Int16 address, const int count) {
+      const int mask = isWord ? 0x0FFE : 0x0FFF;
+      Int16 addr;
+      if (this->effectiveAddress (index, decoded, address, addr)) {
+         this->loadPage (true, addr);
+         this->sideExitIfNull (address, count);
+         this->e.alu (aluMov, RCX, hostRegister [reg]);
+         if (isWord) this->e.swapBytes16 (RCX);
+         this->e.store (isWord, RCX, RDX, addr & mask);
+         this->e.aluImmediate (aluMov, RSI, addr);
+      } else {
+         this->e.alu (aluMov, RSI, RAX);
+         this->loadPage (true);
+         this->sideExitIfNull (address, count);
+         this->e.aluImmediate (aluAnd, RAX, mask);
+         this->e.alu (aluMov, RCX, hostRegister [reg]);
+         if (isWord) this->e.swapBytes16 (RCX);
+         this->e.storeIndexed (isWord, RCX, RDX, RAX);
+      }
+
+      this->e.mov64 (RDI, RBX);
+      this->e.call (this->notify);
+      this->e.compareByteImmediate (RBX, this->dispStale, 0);
+      unsigned char* over = this->e.jumpShortIf (ccE);
+      this->exit (address + 2, count + 1);
+      this->e.patchShort (over);
+   }
+
+   //---------------------------------------------------------------------------
+   // Register = ECX (or immediate), sign extended.
+   //
+   void setRegister (const int reg, const int source) {
+      this->e.signExtend16 (hostRegister [reg], source);
+   }
+
+   void deferCompare (const int a, const int b, const bool bIsRegister) {
+      this->e.store32Immediate (RBX, this->dispKind, ALP_Processor::compareTriggers);
+      this->e.store32 (a, RBX, this->dispTriggerA);
+      if (bIsRegister) {
+         this->e.store32 (b, RBX, this->dispTriggerB);
+      } else {
+         this->e.store32Immediate (RBX, this->dispTriggerB, b);
+      }
+   }
+
+   void deferArithmetic (const int result) {
+      this->e.store32Immediate (RBX, this->dispKind, ALP_Processor::arithmeticTriggers);
+      this->e.store32 (result, RBX, this->dispTriggerA);
+   }
+
+   //---------------------------------------------------------------------------
+   // The basic operations, with the operand in ECX.
+   // Returns the deferred trigger kind, if any, or -1.
+   //
+   enum Operations { opSet, opAdd, opSub, opCmp, opAnd, opNeq, opIor };
+
+   int operation (const Operations op, const int reg) {
+      const int x = hostRegister [reg];
+      switch (op) {
+         case opSet:
+            this->setRegister (reg, RCX);
+            if (reg == regT) return -1;     // T is set direct - no triggers
+            this->deferCompare (x, 0, false);
+            return ALP_Processor::compareTriggers;
+
+         case opAdd:
+         case opSub:
+            this->e.alu (aluMov, RAX, x);
+            this->e.alu (op == opAdd ? aluAdd : aluSub, RAX, RCX);
+            this->setRegister (reg, RAX);
+            this->deferArithmetic (RAX);
+            return ALP_Processor::arithmeticTriggers;
+
+         case opCmp:
+            this->deferCompare (x, RCX, true);
+            return ALP_Processor::compareTriggers;
+
+         case opAnd:
+         case opNeq:
+         case opIor:
+            this->e.alu (op == opAnd ? aluAnd : (op == opNeq ? aluXor : aluOr), x, RCX);
+            this->setRegister (reg, x);
+            return -1;
+      }
+      return -1;
+   }
+};
+
+//------------------------------------------------------------------------------
+// Called from native code after a memory write.
+//
+void JIT_Compiler::memoryModified (ALP_Processor* processor, const int addr)
+{
+   processor->dataBus->memoryModified (Int16 (addr));
+}
+
+#endif  // L16E_NATIVE_X86_64
+
+
+//------------------------------------------------------------------------------
+// JIT_Compiler
+//------------------------------------------------------------------------------
+//
+JIT_Compiler::JIT_Compiler (ALP_Processor* processorIn) :
+   processor (processorIn),
+   codeBuffer (nullptr),
+   used (0)
+{
+#ifdef L16E_NATIVE_X86_64
+   void* buffer = mmap (nullptr, codeBufferSize, PROT_READ | PROT_EXEC,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (buffer == MAP_FAILED) {
+      perror ("JIT_Compiler mmap");
+   } else {
+      this->codeBuffer = static_cast <unsigned char*> (buffer);
+   }
+#endif
+}
+
+//------------------------------------------------------------------------------
+//
+JIT_Compiler::~JIT_Compiler ()
+{
+#ifdef L16E_NATIVE_X86_64
+   if (this->codeBuffer) munmap (this->codeBuffer, codeBufferSize);
+#endif
+}
+
+//------------------------------------------------------------------------------
+//
+bool JIT_Compiler::isAvailable ()
+{
+#ifdef L16E_NATIVE_X86_64
+   return true;
+#else
+   return false;
+#endif
+}
+
+//------------------------------------------------------------------------------
+//
+void JIT_Compiler::reset ()
+{
+   this->used = 0;
+}
+
+//------------------------------------------------------------------------------
+//
+bool JIT_Compiler::isFull () const
+{
+   return this->used + maximumCodeSize > codeBufferSize;
+}
+
+//------------------------------------------------------------------------------
+//
+bool JIT_Compiler::compile (ALP_Processor::Block* block)
+{
+#ifdef L16E_NATIVE_X86_64
+   if (!this->codeBuffer || this->isFull ()) return false;
+
+   // Writable while we compile, executable otherwise.
+   //
+   if (mprotect (this->codeBuffer, codeBufferSize, PROT_READ | PROT_WRITE) != 0) {
+      perror ("JIT_Compiler mprotect");
+      return false;
+   }
+
+   const unsigned int level = this->processor->level;
+   unsigned char* const start = this->codeBuffer + this->used;
+   Emitter emit (start);
+   BlockCompiler bc (this->processor, level, emit,
+                     reinterpret_cast <const void*> (&JIT_Compiler::memoryModified));
+
+   // The common epilogue goes first, so that all exits are backward jumps.
+   //
+   bc.epilogue = emit.p;
+   bc.emitEpilogue ();
+
+   unsigned char* const entry = emit.p;
+   bc.emitPrologue ();
+
+   int knownKind = -1;    // trigger kind, if set within this block
+   int number = 0;        // number of instructions compiled
+   bool jumped = false;
+
+   for (int j = 0; j < block->length && !jumped; j++) {
+      const ALP_Processor::Decoded& decoded = block->code [j];
+      const Int16 address = block->start + 2*j;
+      const int op = decoded.handler >> 1;
+      const bool isWord = (decoded.handler & 1) == 0;
+      const int y = (op >> 1) & 3;
+
+      if (op < 0x20) {
+         // SET (T direct)
+         bc.readOperand (y, isWord, decoded, address, j);
+         const int kind = bc.operation (BlockCompiler::opSet, op >> 3);
+         if (kind >= 0) knownKind = kind;
+
+      } else if (op < 0x40) {
+         // STR
+         bc.writeOperand ((op >> 3) & 3, y, isWord, decoded, address, j);
+
+      } else if (op < 0x80) {
+         // ADD and CMP
+         bc.readOperand (y, isWord, decoded, address, j);
+         knownKind = bc.operation (op < 0x60 ? BlockCompiler::opAdd : BlockCompiler::opCmp,
+                                   (op >> 3) & 3);
+
+      } else if (op < 0xC0) {
+         // SUB, AND, NEQ and IOR - A and R only
+         static const BlockCompiler::Operations ops [4] = {
+            BlockCompiler::opSub, BlockCompiler::opAnd,
+            BlockCompiler::opNeq, BlockCompiler::opIor
+         };
+         bc.readOperand (y, isWord, decoded, address, j);
+         const int kind = bc.operation (ops [(op >> 4) & 3], (op >> 3) & 1);
+         if (kind >= 0) knownKind = kind;
+
+      } else if (op < 0xD0) {
+         // J and JS - for jumps byte mode selects indirect.
+         const bool isJS = (op >= 0xC8);
+         Int16 target = 0;
+         const bool isConstant = isWord && (y == indexP);
+         if (isConstant) {
+            target = Int16 (address + 2 + decoded.offset);
+         } else if (isWord) {
+            emit.alu (aluMov, RAX, hostRegister [y]);
+            emit.aluImmediate (aluAdd, RAX, decoded.offset);
+         } else {
+            bc.readOperand (y, true, decoded, address, j);
+            emit.alu (aluMov, RAX, RCX);
+         }
+
+         if (isJS) emit.aluImmediate (aluMov, hostRegister [regS], Int16 (address + 2));
+
+         if (isConstant) {
+            bc.exit (target, j + 1);
+         } else {
+            emit.store (true, RAX, RBX, bc.dispP);
+            bc.exitKeepP (j + 1);
+         }
+         jumped = true;
+
+      } else if (op < 0xD8) {
+         // Conditional jumps - we need to know how the triggers were set.
+         if (knownKind < 0) break;
+
+         const bool onC = (op >= 0xD4);
+         const bool whenSet = (op == 0xD0) || (op == 0xD4);
+
+         emit.load32 (RAX, RBX, bc.dispTriggerA);
+         int condition;
+         if (knownKind == ALP_Processor::compareTriggers) {
+            emit.load32 (RCX, RBX, bc.dispTriggerB);
+            emit.alu (aluCmp, RAX, RCX);
+            condition = onC ? ccE : ccL;                 // a == b, a < b
+         } else if (onC) {
+            emit.testEaxImmediate (0x10000);             // bit 16
+            condition = ccNE;
+         } else {
+            emit.signExtend16 (RCX, RAX);                // out of range
+            emit.alu (aluCmp, RCX, RAX);
+            condition = ccNE;
+         }
+         if (!whenSet) condition ^= 1;                   // inverse condition
+
+         unsigned char* taken = emit.jumpShortIf (condition);
+         bc.exit (address + 2, j + 1);
+         emit.patchShort (taken);
+
+         if (isWord) {
+            bc.exit (Int16 (address + 2 + decoded.offset), j + 1);
+         } else {
+            bc.readOperand (indexP, true, decoded, address, j);
+            emit.store (true, RCX, RBX, bc.dispP);
+            bc.exitKeepP (j + 1);
+         }
+         jumped = true;
+
+      } else if (op < 0xE0) {
+         // MLT
+         bc.readOperand (y, isWord, decoded, address, j);
+         emit.alu (aluMov, RAX, hostRegister [regA]);
+         emit.multiply (RAX, RCX);
+         emit.alu (aluAdd, RAX, RAX);
+         bc.setRegister (regR, RAX);
+         emit.shift (7, RAX, 16);                        // sar
+         bc.setRegister (regA, RAX);
+
+      } else {
+         // Literals - shifts and specials not compiled.
+         const int kind = op & 7;
+         if (kind == 7) break;
+         emit.aluImmediate (aluMov, RCX, decoded.lsiByte);
+         const int triggers = bc.operation (BlockCompiler::Operations (kind), (op >> 3) & 3);
+         if (triggers >= 0) knownKind = triggers;
+      }
+
+      number = j + 1;
+   }
+
+   if (number > 0 && !jumped) {
+      bc.exit (Int16 (block->start + 2*number), number);
+   }
+
+   if (number > 0) {
+      block->native = reinterpret_cast <ALP_Processor::NativeCode> (entry);
+      block->nativeLength = number;
+      block->nativeLevel = level;
+      this->used += emit.p - start;
+      this->used = (this->used + 15) & ~size_t (15);
+   }
+
+   if (mprotect (this->codeBuffer, codeBufferSize, PROT_READ | PROT_EXEC) != 0) {
+      perror ("JIT_Compiler mprotect");
+      block->native = nullptr;
+      return false;
+   }
+
+   return number > 0;
+#else
+   return false;
+#endif
+}
+
+// end
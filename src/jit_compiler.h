@@ -0,0 +1,75 @@
+/* jit_compiler.h
+ *
+ * This file is part of the Locus 16 Emulator application.
+ *
+ * SPDX-FileCopyrightText: 2021-2025  Andrew C. Starritt
+ * SPDX-License-Identifier: LGPL-3.0-only
+ *
+ * Contact details:
+ * andrew.starritt@gmail.com
+ */
+
+#ifndef L16E_JIT_COMPILER_H
+#define L16E_JIT_COMPILER_H
+
+#include <stddef.h>
+#include "alp_processor.h"
+
+namespace L16E {
+
+// Compiles translated blocks into native (x86-64) code.
+//
+// The current level A, R, S and T registers are held in host registers for
+// the whole block. Memory reads and writes use the processor's page table
+// inline; pages without a host pointer (the I/O page, ROM writes) cause a
+// side exit, i.e. the native code returns early with P set to the instruction
+// that the interpreter is to execute next. Memory writes are still notified
+// to the data bus, and the native code also exits early when that causes the
+// translated blocks to become stale.
+//
+// Instructions not (yet) compiled, e.g. shifts and specials, and conditional
+// jumps that depend on triggers set before the start of the block, end the
+// native code, and are left to the block translator.
+//
+class JIT_Compiler {
+public:
+   explicit JIT_Compiler (ALP_Processor* processor);
+   ~JIT_Compiler ();
+
+   // Is native code available on this host.
+   //
+   static bool isAvailable ();
+
+   // Compiles the block for the current level, setting the block native,
+   // nativeLength and nativeLevel. Returns false if nothing compiled, e.g.
+   // the first instruction is not supported or the code buffer is full.
+   //
+   bool compile (ALP_Processor::Block* block);
+
+   // Discards all native code - the blocks that refer to it must be discarded
+   // as well.
+   //
+   void reset ();
+
+   bool isFull () const;
+
+private:
+   enum Constants {
+      codeBufferSize = 4*1024*1024,
+      maximumCodeSize = 8*1024        // per block - a generous estimate
+   };
+
+   class BlockCompiler;       // see jit_compiler.cpp
+
+   // Called from native code after each memory write.
+   //
+   static void memoryModified (ALP_Processor* processor, const int addr);
+
+   ALP_Processor* const processor;
+   unsigned char* codeBuffer;
+   size_t used;
+};
+
+}
+
+#endif // L16E_JIT_COMPILER_H
@@ -0,0 +1,224 @@
+/* machine.cpp
+ *
+ * This file is part of the Locus 16 Emulator application.
+ *
+ * SPDX-FileCopyrightText: 2021-2025  Andrew C. Starritt
+ * SPDX-License-Identifier: LGPL-3.0-only
+ *
+ * Contact details:
+ * andrew.starritt@gmail.com
+ */
+
+#include "machine.h"
+#include <stdio.h>
+#include <iostream>
+
+#include "alp_processor.h"
+#include "clock.h"
+#include "configuration.h"
+#include "diagnostics.h"
+#include "memory.h"
+#include "tape_punch.h"
+#include "tape_reader.h"
+#include "terminal.h"
+
+using namespace L16E;
+
+//------------------------------------------------------------------------------
+//
+Machine::Machine () :
+   dataBus (new DataBus()),
+   diagnostics (new Diagnostics (this->dataBus)),
+   count (0),
+   processor1 (nullptr),
+   processor2 (nullptr),
+   mapper (nullptr),
+   clock (nullptr)
+{
+   for (int p = 0; p < ARRAY_LENGTH (this->crate); p++) this->crate [p] = nullptr;
+}
+
+//------------------------------------------------------------------------------
+//
+Machine::~Machine ()
+{
+   // The devices first, as they may refer to the peripherals.
+   //
+   const int n = this->dataBus->deviceCount();
+   for (int d = 0; d < n; d++) {
+      delete this->dataBus->getDevice (d);
+   }
+
+   for (int p = 0; p < this->count; p++) {
+      delete this->crate [p];
+   }
+
+   delete this->diagnostics;
+   delete this->dataBus;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Machine::configure (const std::string iniFile)
+{
+   const bool status = Configuration::readConfiguration (iniFile, this);
+   if (!status) return false;
+
+   // List all available peripherals and devices.
+   //
+   this->listPeripherals();
+   this->dataBus->listDevices();
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Machine::initialise (const std::string programFile,
+                          const std::string outputFile)
+{
+   bool status;
+
+   // Load program file "tape" into the tape reader.
+   //
+   TapeReader* reader = this->findPeripheral<TapeReader>();
+   if (reader) {
+      reader->setFilename (programFile);
+   }
+
+   TapePunch* punch = this->findPeripheral<TapePunch>();
+   if (punch) {
+      punch->setFilename (outputFile);
+   }
+
+   // Initialise peripherals and devices.
+   //
+   status = true;   // hypothesize all okay
+   for (int p = 0; p < this->count; p++) {
+      status &= this->crate [p]->initialise();
+   }
+   if (!status) return false;
+
+   status = this->dataBus->initialiseDevices();
+   if (!status) return false;
+
+   this->processor1 = this->findDevice <ALP_Processor> (1);
+   this->processor2 = this->findDevice <ALP_Processor> (2);
+   this->mapper = this->findDevice <MemoryMapper> ();
+   this->clock = this->findDevice <Clock> ();
+
+   if (this->processor1) this->processor1->setDiagnostics (this->diagnostics);
+   if (this->processor2) this->processor2->setDiagnostics (this->diagnostics);
+
+   // The instruction duration depends on the number of ALP processors.
+   //
+   if (this->clock) {
+      const int alpCount = (this->processor1 ? 1 : 0) +
+                           (this->processor2 ? 1 : 0);
+      this->clock->setNumberActiveDevices (alpCount);
+   }
+
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+void Machine::setHeadless (const bool headless)
+{
+   for (int p = 0; p < this->count; p++) {
+      Terminal* terminal = dynamic_cast <Terminal*> (this->crate [p]);
+      if (terminal) terminal->setHeadless (headless);
+   }
+}
+
+//------------------------------------------------------------------------------
+//
+bool Machine::addPeripheral (Peripheral* peripheral)
+{
+   if (!peripheral) return false;
+
+   if (this->count >= Peripheral::maximumNumberOfPeripherals) {
+      std::cerr << "*** too many peripherals" << std::endl;
+      return false;
+   }
+
+   this->crate [this->count] = peripheral;
+   this->count++;
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+int Machine::peripheralCount () const
+{
+   return this->count;
+}
+
+//------------------------------------------------------------------------------
+//
+Peripheral* Machine::getPeripheral (const int index) const
+{
+   Peripheral* peripheral = nullptr;
+   if ((index >= 0) && (index < this->count)) {
+      peripheral = this->crate [index];
+   }
+   return peripheral;
+}
+
+//------------------------------------------------------------------------------
+//
+void Machine::listPeripherals () const
+{
+   std::cout << "Available peripherals" << std::endl;
+   for (int p = 0; p < this->count; p++) {
+      Peripheral* peripheral = this->crate [p];
+
+      char buffer [80];
+
+      snprintf(buffer, sizeof (buffer),
+               "%2d %-20s", p+1, peripheral->getName());
+
+      std::cout << buffer << std::endl;
+   }
+   std::cout << std::endl;
+}
+
+//------------------------------------------------------------------------------
+//
+DataBus* Machine::getDataBus () const
+{
+   return this->dataBus;
+}
+
+//------------------------------------------------------------------------------
+//
+Diagnostics* Machine::getDiagnostics () const
+{
+   return this->diagnostics;
+}
+
+//------------------------------------------------------------------------------
+//
+ALP_Processor* Machine::getProcessor (const int number) const
+{
+   switch (number) {
+      case 1:  return this->processor1;
+      case 2:  return this->processor2;
+      default: return nullptr;
+   }
+}
+
+//------------------------------------------------------------------------------
+//
+MemoryMapper* Machine::getMapper () const
+{
+   return this->mapper;
+}
+
+//------------------------------------------------------------------------------
+//
+Clock* Machine::getClock () const
+{
+   return this->clock;
+}
+
+// end
@@ -0,0 +1,124 @@
+/* machine.h
+ *
+ * This file is part of the Locus 16 Emulator application.
+ *
+ * SPDX-FileCopyrightText: 2021-2025  Andrew C. Starritt
+ * SPDX-License-Identifier: LGPL-3.0-only
+ *
+ * Contact details:
+ * andrew.starritt@gmail.com
+ */
+
+#ifndef L16E_MACHINE_H
+#define L16E_MACHINE_H
+
+#include <string>
+#include "locus16_common.h"
+#include "data_bus.h"
+#include "peripheral.h"
+
+namespace L16E {
+
+class ALP_Processor;
+class Clock;
+class Diagnostics;
+class MemoryMapper;
+
+// A complete emulated Locus 16 system, i.e. the crate (data bus and devices),
+// the peripherals and the diagnostics. The machine owns all of these, and
+// machines share no state, so any number may be created within one process.
+//
+class Machine {
+public:
+   explicit Machine ();
+   ~Machine ();    // deletes all devices and peripherals
+
+   // Reads the configuration, creating the specified peripherals and devices,
+   // and lists them.
+   //
+   bool configure (const std::string iniFile);
+
+   // Loads the program and output "tapes" into the (first) tape reader and
+   // tape punch, if any, and initialises all peripherals and devices.
+   //
+   bool initialise (const std::string programFile,
+                    const std::string outputFile);
+
+   // Terminals use the standard input and output, rather than each opening
+   // an xterm, e.g. in batch mode. Must be called before initialise.
+   //
+   void setHeadless (const bool headless);
+
+   // The machine takes ownership of the peripheral.
+   //
+   bool addPeripheral (Peripheral* peripheral);
+   int peripheralCount () const;
+   Peripheral* getPeripheral (const int index) const;
+   void listPeripherals () const;  // prints to stdout
+
+   DataBus* getDataBus () const;
+   Diagnostics* getDiagnostics () const;
+
+   // As found on initialisation, nullptr if none.
+   //
+   ALP_Processor* getProcessor (const int number) const;   // 1 or 2
+   MemoryMapper* getMapper () const;
+   Clock* getClock () const;
+
+   // Find the first peripheral or the ordinal'th device of the specified
+   // type, or nullptr if none.
+   //
+   template <class PeripheralType> PeripheralType* findPeripheral () const;
+   template <class DeviceType> DeviceType* findDevice (int ordinal = 1) const;
+
+private:
+   DataBus* const dataBus;
+   Diagnostics* const diagnostics;
+
+   int count;
+   Peripheral* crate [Peripheral::maximumNumberOfPeripherals];
+
+   ALP_Processor* processor1;
+   ALP_Processor* processor2;
+   MemoryMapper* mapper;
+   Clock* clock;
+};
+
+//------------------------------------------------------------------------------
+//
+template <class PeripheralType>
+PeripheralType* Machine::findPeripheral () const
+{
+   for (int p = 0; p < this->count; p++) {
+      PeripheralType* peripheral = dynamic_cast <PeripheralType*> (this->crate [p]);
+      if (peripheral) {
+         // Found it (or the first at least)
+         return peripheral;
+      }
+   }
+   return nullptr;
+}
+
+//------------------------------------------------------------------------------
+//
+template <class DeviceType>
+DeviceType* Machine::findDevice (int ordinal) const
+{
+   const int n = this->dataBus->deviceCount();
+   for (int d = 0; d < n; d++) {
+      DeviceType* device = dynamic_cast <DeviceType*> (this->dataBus->getDevice(d));
+      if (device) {
+         // Found it the required class
+         if (ordinal == 1) {
+            // Found it the required instance
+            return device;
+         }
+         ordinal--;
+      }
+   }
+   return nullptr;
+}
+
+}
+
+#endif // L16E_MACHINE_H
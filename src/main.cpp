@@ -58,7 +58,6 @@ PUT_RESOURCE (preamble,      Preamble_txt)
 int main(int argc, char** argv)
 {
    std::string p1;
-   std::string p2;
 
    // skip program name.
    //
@@ -109,30 +108,173 @@ int main(int argc, char** argv)
 
    // Read actual program options and arguments.
    //
-   // This slows the emulator down to approximatley real-time.
-   // At least on my setup at home.
-   //
-   int sm = 26;   // default;
+   RunOptions options;
+   options.iniFile = "locus16.ini";
+   options.engine = L16E::ALP_Processor::interpreter;
+   options.fastForward = false;
+   options.speed = -1.0;               // not specified
+   options.parallel = false;
+   options.opcodeCounting = false;
+   options.addressCounting = false;
+   options.traceFile = "";
+   options.loadFile = "";
+   options.saveFile = "";
+   options.batch = false;
+   options.maxInstructions = 0x7FFFffffFFFFffff;
+   options.untilAddress = -1;          // none
+
+   while (argc >= 1) {
+      p1 = argv [0];
+      int skip = 2;    // option and option value
+
+      if (p1 == "-s" || p1 == "--sleep") {
+         // Obsolete - the emulator now paces itself. Still accepted, so as
+         // not to break existing scripts.
+         //
+         if (argc >= 2) {
 
-   if (p1 == "-s" || p1 == "--sleep") {
-      if (argc >= 2) {
+            int sm;
+            int n = sscanf(argv [1], "%d", &sm);
+            if (n != 1 || sm < 1) {
+               std::cerr << "non integer or non positive sleep option value" << std::endl;
+               return 1;
+            }
 
-         int n = sscanf(argv [1], "%d", &sm);
-         if (n != 1 || sm < 1) {
-            std::cerr << "non integer or non positive sleep option value" << std::endl;
+         } else {
+            std::cerr << "missing sleep option value" << std::endl;
+            help_usage (std::cerr);
             return 1;
          }
 
-         // Skip option and option value
-         //
-         argc -= 2;
-         argv += 2;
+      } else if (p1 == "-e" || p1 == "--engine") {
+         if (argc >= 2) {
+            const std::string name = argv [1];
+            if (name == "interpreter") {
+               options.engine = L16E::ALP_Processor::interpreter;
+            } else if (name == "block") {
+               options.engine = L16E::ALP_Processor::blockTranslator;
+            } else if (name == "jit") {
+               options.engine = L16E::ALP_Processor::nativeCompiler;
+            } else {
+               std::cerr << "invalid engine option value: " << name << std::endl;
+               return 1;
+            }
+
+         } else {
+            std::cerr << "missing engine option value" << std::endl;
+            help_usage (std::cerr);
+            return 1;
+         }
+
+      } else if (p1 == "-f" || p1 == "--fast-forward") {
+         options.fastForward = true;
+         skip = 1;    // no option value
+
+      } else if (p1 == "-x" || p1 == "--speed") {
+         if (argc >= 2) {
+
+            const std::string text = argv [1];
+            if (text == "max" || text == "MAX") {
+               options.speed = 0.0;   // unthrottled
+            } else {
+               int n = sscanf(argv [1], "%lf", &options.speed);
+               if (n != 1 || options.speed <= 0.0) {
+                  std::cerr << "non numeric or non positive speed option value" << std::endl;
+                  return 1;
+               }
+            }
+
+         } else {
+            std::cerr << "missing speed option value" << std::endl;
+            help_usage (std::cerr);
+            return 1;
+         }
+
+      } else if (p1 == "-p" || p1 == "--parallel") {
+         options.parallel = true;
+         skip = 1;    // no option value
+
+      } else if (p1 == "-H" || p1 == "--histogram") {
+         options.opcodeCounting = true;
+         skip = 1;    // no option value
+
+      } else if (p1 == "-C" || p1 == "--count-addresses") {
+         options.addressCounting = true;
+         skip = 1;    // no option value
+
+      } else if (p1 == "-t" || p1 == "--trace") {
+         if (argc >= 2) {
+            options.traceFile = argv [1];
+         } else {
+            std::cerr << "missing trace option value" << std::endl;
+            help_usage (std::cerr);
+            return 1;
+         }
+
+      } else if (p1 == "-L" || p1 == "--load") {
+         if (argc >= 2) {
+            options.loadFile = argv [1];
+         } else {
+            std::cerr << "missing load option value" << std::endl;
+            help_usage (std::cerr);
+            return 1;
+         }
+
+      } else if (p1 == "-S" || p1 == "--save") {
+         if (argc >= 2) {
+            options.saveFile = argv [1];
+         } else {
+            std::cerr << "missing save option value" << std::endl;
+            help_usage (std::cerr);
+            return 1;
+         }
+
+      } else if (p1 == "-b" || p1 == "--batch") {
+         options.batch = true;
+         skip = 1;    // no option value
+
+      } else if (p1 == "-m" || p1 == "--max-instructions") {
+         if (argc >= 2) {
+
+            long temp;
+            int n = sscanf(argv [1], "%ld", &temp);
+            if (n != 1 || temp < 1) {
+               std::cerr << "non integer or non positive max instructions option value" << std::endl;
+               return 1;
+            }
+            options.maxInstructions = temp;
+
+         } else {
+            std::cerr << "missing max instructions option value" << std::endl;
+            help_usage (std::cerr);
+            return 1;
+         }
+
+      } else if (p1 == "-a" || p1 == "--until-address") {
+         if (argc >= 2) {
+
+            unsigned temp;
+            int n = sscanf(argv [1], "%x", &temp);
+            if (n != 1 || temp > 0xFFFF || (temp & 1) != 0) {
+               std::cerr << "invalid until address option value" << std::endl;
+               return 1;
+            }
+            options.untilAddress = int (temp);
+
+         } else {
+            std::cerr << "missing until address option value" << std::endl;
+            help_usage (std::cerr);
+            return 1;
+         }
 
       } else {
-         std::cerr << "missing sleep option value" << std::endl;
-         help_usage (std::cerr);
-         return 1;
+         break;   // not an option
       }
+
+      // Skip option and option value, if any
+      //
+      argc -= skip;
+      argv += skip;
    }
 
    if (argc < 1) {
@@ -140,18 +282,24 @@ int main(int argc, char** argv)
       help_usage (std::cerr);
       return 1;
    }
-   p1 = argv [0];
+   options.programFile = argv [0];
 
-   p2 = "punchout.txt";
+   options.outputFile = "punchout.txt";
    if (argc >= 2) {
-      p2 = argv [1];
+      options.outputFile = argv [1];
    }
 
-   preamble (std::cout);
-   std::cout << std::endl;
+   if (!options.batch) {
+      preamble (std::cout);
+      std::cout << std::endl;
+   }
+
+   // Real time by default, except in batch mode.
+   //
+   if (options.speed < 0.0) options.speed = options.batch ? 0.0 : 1.0;
 
    version (std::cout);
-   return run ("locus16.ini", p1, p2, sm);
+   return run (options);
 }
 
 // end
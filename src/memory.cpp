@@ -12,6 +12,7 @@
 #include "memory.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <iostream>
 
@@ -109,6 +110,8 @@ void MemoryMapper::setWord(const Int16 addr,
       int block = 10 + (4 * index) + j;   // 10 is offset for mappable memory
       this->offsets[slot][2 + j] = block * blockSize;
    }
+
+   this->dataBus->mappingModified (slot);
 }
 
 //------------------------------------------------------------------------------
@@ -130,6 +133,45 @@ int MemoryMapper::mapAddress (const Int16 addr) const
    _exit (12);
 }
 
+//------------------------------------------------------------------------------
+//
+int MemoryMapper::mapAddress (const Int16 addr, const int activeIdentity) const
+{
+   if (activeIdentity < 0 || activeIdentity >= maximumNumberOfMaps) return noOffset;
+
+   const int msAddrNib = (addr >> 12) & 15;    // 0 to 15
+   const int offset = this->offsets[activeIdentity][msAddrNib];
+   if (offset >= 0) {
+       return offset + (addr & 0x0FFF);
+   }
+   return noOffset;
+}
+
+
+//------------------------------------------------------------------------------
+//
+void MemoryMapper::saveState (std::vector<UInt8>& state) const
+{
+   const UInt8* p = reinterpret_cast <const UInt8*> (this->mapValues);
+   state.assign (p, p + sizeof (this->mapValues));
+}
+
+//------------------------------------------------------------------------------
+//
+bool MemoryMapper::restoreState (const UInt8* state, const size_t size)
+{
+   Int16 values [maximumNumberOfMaps];
+   if (size != sizeof (values)) return false;
+   memcpy (values, state, sizeof (values));
+
+   // Go via setWord so that the offsets are recalculated and the active
+   // devices informed.
+   //
+   for (int slot = 0; slot < maximumNumberOfMaps; slot++) {
+      this->setWord (mapRegisterStart + 2*slot, values [slot]);
+   }
+   return true;
+}
 
 //==============================================================================
 // Memory
@@ -184,6 +226,7 @@ void Memory::setByte(const Int16 addr, const UInt8 value)
 {
    const int paddr = this->controller->mapAddress(addr);
    this->bytePtr[paddr] = value;
+   this->dataBus->memoryModified (addr);
 }
 
 //------------------------------------------------------------------------------
@@ -196,6 +239,17 @@ Int16 Memory::getWord(const Int16 addr) const
    return __builtin_bswap16 (this->wordPtr [paddr >> 1]);
 }
 
+//------------------------------------------------------------------------------
+// The mapping is the same for the whole page, so we can give direct access.
+//
+UInt8* Memory::getHostPage (const Int16 addr, const int activeIdentity,
+                            const bool)
+{
+   const int paddr = this->controller->mapAddress(addr & 0xF000, activeIdentity);
+   if (paddr < 0) return nullptr;
+   return &this->bytePtr [paddr];
+}
+
 //------------------------------------------------------------------------------
 //
 void Memory::setWord(const Int16 addr, const Int16  value)
@@ -204,6 +258,25 @@ void Memory::setWord(const Int16 addr, const Int16  value)
    //
    const int paddr = this->controller->mapAddress(addr);
    this->wordPtr [paddr >> 1] = __builtin_bswap16 (value);
+   this->dataBus->memoryModified (addr);
+}
+
+//------------------------------------------------------------------------------
+//
+void Memory::saveState (std::vector<UInt8>& state) const
+{
+   state.assign (this->bytePtr, this->bytePtr + totalSize);
+}
+
+//------------------------------------------------------------------------------
+// The snapshot restore tells the active devices once all devices have been
+// restored, whatever the order of the devices.
+//
+bool Memory::restoreState (const UInt8* state, const size_t size)
+{
+   if (size != totalSize) return false;
+   memcpy (this->memory, state, totalSize);
+   return true;
 }
 
 // end
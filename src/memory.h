@@ -47,6 +47,11 @@ public:
    Int16 getWord(const Int16 addr) const;
    void setWord(const Int16 addr, const Int16  value);
 
+   // The state is the map values.
+   //
+   void saveState (std::vector<UInt8>& state) const;
+   bool restoreState (const UInt8* state, const size_t size);
+
 private:
    friend class Memory;
 
@@ -54,6 +59,11 @@ private:
    //
    int mapAddress (const Int16 addr) const;
 
+   // As above, but for the specified active device, and returns -1 if the
+   // address is not mapped to memory.
+   //
+   int mapAddress (const Int16 addr, const int activeIdentity) const;
+
    // Do we need a map word for each device instance, say if two ALPs.
    // Likewise 2 or more pre calculated offsets.
    //
@@ -81,6 +91,14 @@ public:
    Int16 getWord(const Int16 addr) const;
    void setWord(const Int16 addr, const Int16  value);
 
+   UInt8* getHostPage (const Int16 addr, const int activeIdentity,
+                       const bool forWriting);
+
+   // The state is the whole of (physical) memory, as is.
+   //
+   void saveState (std::vector<UInt8>& state) const;
+   bool restoreState (const UInt8* state, const size_t size);
+
 private:
    const int number;
    MemoryMapper* const controller;   // pointer constant, not the contents
@@ -0,0 +1,145 @@
+/* pacer.cpp
+ *
+ * This file is part of the Locus 16 Emulator application.
+ *
+ * SPDX-FileCopyrightText: 2021-2025  Andrew C. Starritt
+ * SPDX-License-Identifier: LGPL-3.0-only
+ *
+ * Contact details:
+ * andrew.starritt@gmail.com
+ */
+
+#include "pacer.h"
+#include <errno.h>
+
+using namespace L16E;
+
+//------------------------------------------------------------------------------
+// Returns the time b - a in uSec.
+//
+static double difference (const struct timespec& a, const struct timespec& b)
+{
+   return 1.0e6 * (b.tv_sec - a.tv_sec) + 1.0e-3 * (b.tv_nsec - a.tv_nsec);
+}
+
+//------------------------------------------------------------------------------
+//
+Pacer::Pacer () :
+   cycleDuration (2.25),
+   speed (1.0),
+   pacedDuration (2.25),
+   emulated (0.0),
+   unchecked (0.0)
+{
+   this->reset();
+}
+
+//------------------------------------------------------------------------------
+//
+Pacer::~Pacer () { }
+
+//------------------------------------------------------------------------------
+//
+void Pacer::setCycleDuration (const double duration)
+{
+   this->cycleDuration = duration;
+   this->update();
+}
+
+//------------------------------------------------------------------------------
+//
+void Pacer::setSpeed (const double speedIn)
+{
+   this->speed = MAX (speedIn, 0.0);
+   this->update();
+   this->reset();
+}
+
+//------------------------------------------------------------------------------
+//
+double Pacer::getSpeed () const
+{
+   return this->speed;
+}
+
+//------------------------------------------------------------------------------
+//
+void Pacer::update ()
+{
+   this->pacedDuration = (this->speed > 0.0) ? this->cycleDuration / this->speed : 0.0;
+}
+
+//------------------------------------------------------------------------------
+//
+void Pacer::reset ()
+{
+   clock_gettime (CLOCK_MONOTONIC, &this->origin);
+   this->emulated = 0.0;
+   this->unchecked = 0.0;
+}
+
+//------------------------------------------------------------------------------
+// When well behind, executeCycles starts again from now, so we only allow for
+// upto the maximum lag. Rounded up, so that once the other threads have used
+// them, executeCycles is due a check and sleeps rather than the caller having
+// to poll for the next cycle.
+//
+int Pacer::cyclesUntilAhead (const int maximum) const
+{
+   if (this->pacedDuration <= 0.0) return maximum;   // unthrottled
+
+   struct timespec now;
+   clock_gettime (CLOCK_MONOTONIC, &now);
+   const double lag = difference (this->origin, now) - this->emulated - this->unchecked;
+
+   const double cycles = (MIN (lag, double (maximumLag)) + pacingInterval) / this->pacedDuration;
+   if (cycles >= maximum) return maximum;
+   return (cycles > 0.0) ? int (cycles) + 1 : 0;
+}
+
+//------------------------------------------------------------------------------
+//
+void Pacer::executeCycles (const int number)
+{
+   if (this->pacedDuration <= 0.0) return;   // unthrottled
+
+   this->unchecked += number * this->pacedDuration;
+   if (this->unchecked < pacingInterval) return;
+
+   this->emulated += this->unchecked;
+   this->unchecked = 0.0;
+
+   struct timespec now;
+   clock_gettime (CLOCK_MONOTONIC, &now);
+   const double lag = difference (this->origin, now) - this->emulated;
+
+   if (lag > maximumLag) {
+      this->reset();
+      return;
+   }
+
+   if (lag >= 0.0) return;   // on time or behind
+
+   // Sleep until the emulated time is due. Rebase the origin now and then
+   // to stop the emulated time losing precision.
+   //
+   const long usec = long (this->emulated);
+   struct timespec due;
+   due.tv_sec = this->origin.tv_sec + usec / 1000000;
+   due.tv_nsec = this->origin.tv_nsec + (usec % 1000000) * 1000;
+   if (due.tv_nsec >= 1000000000) {
+      due.tv_sec += 1;
+      due.tv_nsec -= 1000000000;
+   }
+
+   while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &due, nullptr) == EINTR) {
+      // SIGINT - just sleep out the remainder, it is short.
+   }
+
+   if (this->emulated >= 1.0e6) {
+      this->origin = due;
+      this->emulated -= usec;
+   }
+}
+
+// end
@@ -0,0 +1,80 @@
+/* pacer.h
+ *
+ * This file is part of the Locus 16 Emulator application.
+ *
+ * SPDX-FileCopyrightText: 2021-2025  Andrew C. Starritt
+ * SPDX-License-Identifier: LGPL-3.0-only
+ *
+ * Contact details:
+ * andrew.starritt@gmail.com
+ */
+
+#ifndef L16E_PACER_H
+#define L16E_PACER_H
+
+#include <time.h>
+#include "locus16_common.h"
+
+namespace L16E {
+
+// Keeps emulated time from running ahead of real time, or of a multiple of
+// real time.
+//
+// The emulated time is the number of instructions executed times the emulated
+// duration of an instruction, divided by the speed. The host is only checked
+// once at least a pacing interval of emulated time has passed, and then sleeps
+// until the absolute time at which the emulated time is due, so that any
+// oversleep is made up by the next check rather than accumulating. If the
+// host falls too far behind (e.g. slow host, or the emulator was stopped) we
+// start again from now rather than trying to catch up.
+//
+class Pacer {
+public:
+   explicit Pacer ();
+   ~Pacer ();
+
+   // Emulated uSec per instruction.
+   //
+   void setCycleDuration (const double duration);
+
+   // Emulated time per real time, e.g. 1.0 for real time or 10.0 for ten
+   // times real time. Zero for unthrottled, i.e. no pacing at all.
+   //
+   void setSpeed (const double speed);
+   double getSpeed () const;
+
+   // Restart from now, e.g. when resuming after a pause.
+   //
+   void reset ();
+
+   // Accounts for number executed instructions, and blocks the host as
+   // needed. Returns immediately for the most part.
+   //
+   void executeCycles (const int number);
+
+   // For instructions executed by other threads, e.g. in parallel mode: the
+   // number that may be executed, beyond those accounted for so far, before
+   // the emulated time runs a pacing interval ahead of real time, upto
+   // maximum. Maximum when unthrottled.
+   //
+   int cyclesUntilAhead (const int maximum) const;
+
+private:
+   enum Constants {
+      pacingInterval = 2000,       // uSec
+      maximumLag = 100000          // uSec
+   };
+
+   void update ();
+
+   double cycleDuration;
+   double speed;
+   double pacedDuration;           // real uSec per instruction, 0 when unthrottled
+   struct timespec origin;         // host time at which emulated time was zero
+   double emulated;                // uSec since origin, divided by speed
+   double unchecked;               // uSec since last checked
+};
+
+}
+
+#endif // L16E_PACER_H
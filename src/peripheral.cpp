@@ -5,20 +5,13 @@
  */
 
 #include "peripheral.h"
+#include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
 #include <iostream>
 
 using namespace L16E;
 
-int Peripheral::count = 0;
-Peripheral* Peripheral::crate [maximumNumberOfPeripherals] ={
-   NULL, NULL, NULL, NULL, NULL,
-   NULL, NULL, NULL, NULL, NULL,
-   NULL, NULL, NULL, NULL, NULL,
-   NULL, NULL, NULL, NULL, NULL
-};
-
 //------------------------------------------------------------------------------
 // static
 void Peripheral::perrorf (const char* format, ...)
@@ -36,13 +29,20 @@ void Peripheral::perrorf (const char* format, ...)
 Peripheral::Peripheral(const char* nameIn):
    name (strndup(nameIn, 40))
 {
-   Peripheral::registerPeripheral (this);
 }
 
 //------------------------------------------------------------------------------
 //
 Peripheral::~Peripheral()
 {
+   free ((void*) this->name);
+}
+
+//------------------------------------------------------------------------------
+//
+const char* Peripheral::getName() const
+{
+   return this->name;
 }
 
 //------------------------------------------------------------------------------
@@ -69,65 +69,25 @@ bool Peripheral::writeByte(const UInt8 value)
    return false;
 }
 
-//------------------------------------------------------------------------------
-// static
-bool Peripheral::registerPeripheral (Peripheral* peripheral)
-{
-   if (Peripheral::count >= maximumNumberOfPeripherals) return false;
-   Peripheral::crate[count] = peripheral;
-   Peripheral::count++;
-   return true;
-}
-
-//------------------------------------------------------------------------------
-// static
-bool Peripheral::initialisePeripherals()
-{
-   bool result = true;   // hypothesize all okay
-
-   for (int p = 0; p < Peripheral::count; p++) {
-      Peripheral*  peripheral= Peripheral::crate [p];
-      result &= peripheral->initialise();
-   }
-
-   return result;
-}
-
 //------------------------------------------------------------------------------
 //
-void Peripheral::listPeripherals()
+int Peripheral::getPollDescriptor() const
 {
-   std::cout << "Available peripherals" << std::endl;
-   for (int p = 0; p < Peripheral::count; p++) {
-      Peripheral* peripheral = Peripheral::crate [p];
-
-      char buffer [80];
-
-      snprintf(buffer, sizeof (buffer),
-               "%2d %-20s", p+1, peripheral->name);
-
-      std::cout << buffer << std::endl;
-   }
-   std::cout << std::endl;
+   return -1;
 }
 
-
 //------------------------------------------------------------------------------
-// static
-int Peripheral::peripheralCount()
+//
+void Peripheral::saveState (std::vector<UInt8>& state) const
 {
-   return Peripheral::count;
+   state.clear();
 }
 
 //------------------------------------------------------------------------------
-// static
-Peripheral* Peripheral::getPeripheral (const int index)
+//
+bool Peripheral::restoreState (const UInt8*, const size_t size)
 {
-   Peripheral* peripheral = nullptr;
-   if ((index >= 0) && (index < Peripheral::count)) {
-      peripheral = Peripheral::crate [index];
-   }
-   return peripheral;
+   return size == 0;
 }
 
 // end
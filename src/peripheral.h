@@ -8,6 +8,8 @@
 #define L16E_PERIPHERAL_H
 
 #include "locus16_common.h"
+#include <stddef.h>
+#include <vector>
 
 namespace L16E {
 
@@ -19,28 +21,29 @@ public:
    };
 
    explicit Peripheral(const char* name);
-   ~Peripheral();
+   virtual ~Peripheral();
+
+   const char* getName() const;
 
    virtual bool initialise();
    virtual bool readByte(UInt8& value);
    virtual bool writeByte(const UInt8 value);
 
-   static bool initialisePeripherals();
-   static void listPeripherals();  // prints to stdout
+   // Host file descriptor that becomes readable when input is available,
+   // or -1 if none, e.g. at end of input.
+   //
+   virtual int getPollDescriptor() const;
 
-   static int peripheralCount();
-   static Peripheral* getPeripheral (const int index);
+   // Snapshot support, as per DataBus::Device.
+   //
+   virtual void saveState (std::vector<UInt8>& state) const;
+   virtual bool restoreState (const UInt8* state, const size_t size);
 
 protected:
    const char* const name;
 
    // Formatted perror function
    static void perrorf (const char* format, ...);
-
-private:
-   static bool registerPeripheral (Peripheral* peripheral);
-   static int count;
-   static Peripheral* crate [maximumNumberOfPeripherals];
 };
 
 }
@@ -101,4 +101,13 @@ Int16 ROM::getWord(const Int16 addr) const
 //
 void ROM::setWord(const Int16 addr, const Int16  value) { }
 
+//------------------------------------------------------------------------------
+// Read only - writes must take the slow path, i.e. be ignored.
+//
+UInt8* ROM::getHostPage (const Int16 addr, const int, const bool forWriting)
+{
+   if (forWriting) return nullptr;
+   return &this->bmem_ptr [Int16 (addr & 0xF000)];
+}
+
 // end
@@ -26,6 +26,9 @@ public:
    Int16 getWord(const Int16 addr) const;
    void setWord(const Int16 addr, const Int16  value);
 
+   UInt8* getHostPage (const Int16 addr, const int activeIdentity,
+                       const bool forWriting);
+
 protected:
    // Initialise rom form the the specified file.
    //
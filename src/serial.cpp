@@ -106,5 +106,38 @@ void Serial::setWord(const Int16 addr, const Int16 value)
    }
 }
 
+//------------------------------------------------------------------------------
+//
+bool Serial::isIdlePoll (const Int16 addr, int& fd) const
+{
+   fd = -1;
+   if ((addr != this->statusRegisterAddress) ||
+       (this->type != Input) ||
+       (!this->peripheral) ||
+       (this->bufferedByteExists)) return false;
+
+   fd = this->peripheral->getPollDescriptor();
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+void Serial::saveState (std::vector<UInt8>& state) const
+{
+   state.clear();
+   state.push_back (this->bufferedByteExists);
+   state.push_back (this->bufferedByte);
+}
+
+//------------------------------------------------------------------------------
+//
+bool Serial::restoreState (const UInt8* state, const size_t size)
+{
+   if (size != 2) return false;
+   this->bufferedByteExists = state [0];
+   this->bufferedByte = state [1];
+   return true;
+}
+
 // end
 
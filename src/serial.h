@@ -42,6 +42,13 @@ public:
    Int16 getWord(const Int16 addr) const;
    void setWord(const Int16 addr, const Int16  value);
 
+   bool isIdlePoll (const Int16 addr, int& fd) const;
+
+   // The state is the buffered input byte, if any.
+   //
+   void saveState (std::vector<UInt8>& state) const;
+   bool restoreState (const UInt8* state, const size_t size);
+
 private:
    const Type type;
    const Int16 statusRegisterAddress;
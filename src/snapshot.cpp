@@ -0,0 +1,227 @@
+/* snapshot.cpp
+ *
+ * Machine snapshot, part of the Locus 16 Emulator.
+ *
+ * SPDX-FileCopyrightText: 2022-2025  Andrew C. Starritt
+ * SPDX-License-Identifier: LGPL-3.0-only
+ *
+ * Contact details:
+ * andrew.starritt@gmail.com
+ */
+
+#include "snapshot.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <iostream>
+#include <vector>
+#include "locus16_common.h"
+#include "data_bus.h"
+#include "machine.h"
+#include "peripheral.h"
+
+using namespace L16E;
+
+static const char magic [8] = "L16SNAP";
+
+//------------------------------------------------------------------------------
+//
+Snapshot::Snapshot () {}
+
+//------------------------------------------------------------------------------
+//
+Snapshot::~Snapshot () {}
+
+//------------------------------------------------------------------------------
+// static
+bool Snapshot::save (const std::string filename, Machine* machine)
+{
+   DataBus* const dataBus = machine->getDataBus();
+   const int numberDevices = dataBus->deviceCount();
+   const int numberPeripherals = machine->peripheralCount();
+   const int numberSections = numberDevices + numberPeripherals;
+
+   // Gather all the state first.
+   //
+   std::vector< std::vector<UInt8> > states (numberSections);
+   std::vector<Section> sections (numberSections);
+
+   uint64_t offset = sizeof (Header) + numberSections * sizeof (Section);
+   for (int j = 0; j < numberSections; j++) {
+      const char* name;
+      if (j < numberDevices) {
+         const DataBus::Device* device = dataBus->getDevice (j);
+         device->saveState (states [j]);
+         name = device->getName();
+      } else {
+         const Peripheral* peripheral = machine->getPeripheral (j - numberDevices);
+         peripheral->saveState (states [j]);
+         name = peripheral->getName();
+      }
+
+      Section& section = sections [j];
+      memset (&section, 0, sizeof (section));
+      strncpy (section.name, name, sizeof (section.name) - 1);
+
+      offset = (offset + alignment - 1) & ~uint64_t (alignment - 1);
+      section.offset = offset;
+      section.size = states [j].size();
+      offset += section.size;
+   }
+
+   Header header;
+   memset (&header, 0, sizeof (header));
+   memcpy (header.magic, magic, sizeof (header.magic));
+   header.version = version;
+   header.byteOrder = byteOrder;
+   header.numberDevices = numberDevices;
+   header.numberPeripherals = numberPeripherals;
+
+   const int fd = open (filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+   if (fd < 0) {
+      perror (filename.c_str());
+      return false;
+   }
+
+   bool status = true;
+   status &= pwrite (fd, &header, sizeof (header), 0) == ssize_t (sizeof (header));
+   status &= pwrite (fd, sections.data(), numberSections * sizeof (Section),
+                     sizeof (Header)) == ssize_t (numberSections * sizeof (Section));
+
+   for (int j = 0; j < numberSections; j++) {
+      const size_t size = states [j].size();
+      if (size == 0) continue;
+      status &= pwrite (fd, states [j].data(), size, sections [j].offset) == ssize_t (size);
+   }
+
+   // Round up to a whole page, so the last section may be mapped as is.
+   //
+   status &= ftruncate (fd, (offset + alignment - 1) & ~uint64_t (alignment - 1)) == 0;
+
+   if (!status) perror (filename.c_str());
+   close (fd);
+   return status;
+}
+
+//------------------------------------------------------------------------------
+// static
+bool Snapshot::restore (const std::string filename, Machine* machine)
+{
+   DataBus* const dataBus = machine->getDataBus();
+   const int numberDevices = dataBus->deviceCount();
+   const int numberPeripherals = machine->peripheralCount();
+   const int numberSections = numberDevices + numberPeripherals;
+
+   const int fd = open (filename.c_str(), O_RDONLY);
+   if (fd < 0) {
+      perror (filename.c_str());
+      return false;
+   }
+
+   struct stat info;
+   if (fstat (fd, &info) < 0) {
+      perror (filename.c_str());
+      close (fd);
+      return false;
+   }
+   const uint64_t fileSize = info.st_size;
+
+   if (fileSize < sizeof (Header)) {
+      std::cerr << filename << ": not a snapshot file\n";
+      close (fd);
+      return false;
+   }
+
+   void* map = mmap (nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+   close (fd);
+   if (map == MAP_FAILED) {
+      perror (filename.c_str());
+      return false;
+   }
+
+   const UInt8* const base = reinterpret_cast <const UInt8*> (map);
+   const Header* const header = reinterpret_cast <const Header*> (base);
+   const Section* const sections = reinterpret_cast <const Section*> (base + sizeof (Header));
+
+   bool status = true;   // hypothesize all okay
+
+   if (memcmp (header->magic, magic, sizeof (header->magic)) != 0) {
+      std::cerr << filename << ": not a snapshot file\n";
+      status = false;
+
+   } else if ((header->version != version) || (header->byteOrder != byteOrder)) {
+      std::cerr << filename << ": unsupported snapshot version " << header->version << "\n";
+      status = false;
+
+   } else if ((int (header->numberDevices) != numberDevices) ||
+              (int (header->numberPeripherals) != numberPeripherals) ||
+              (fileSize < sizeof (Header) + numberSections * sizeof (Section)))
+   {
+      std::cerr << filename << ": snapshot does not match the configuration\n";
+      status = false;
+   }
+
+   // Check every section before restoring any, so that a mismatch leaves
+   // the machine as it was.
+   //
+   for (int j = 0; status && (j < numberSections); j++) {
+      const Section& section = sections [j];
+      const char* name;
+      if (j < numberDevices) {
+         name = dataBus->getDevice (j)->getName();
+      } else {
+         name = machine->getPeripheral (j - numberDevices)->getName();
+      }
+
+      if ((strncmp (section.name, name, sizeof (section.name) - 1) != 0) ||
+          (section.offset > fileSize) || (section.size > fileSize - section.offset))
+      {
+         std::cerr << filename << ": snapshot does not match the configuration ("
+                   << name << ")\n";
+         status = false;
+      }
+   }
+
+   // A device may still reject its state, in which case we carry on with the
+   // rest, but the machine as a whole is no longer consistent.
+   //
+   const bool isChecked = status;
+   for (int j = 0; isChecked && (j < numberSections); j++) {
+      const Section& section = sections [j];
+      const UInt8* state = base + section.offset;
+      bool okay;
+      const char* name;
+      if (j < numberDevices) {
+         DataBus::Device* device = dataBus->getDevice (j);
+         name = device->getName();
+         okay = device->restoreState (state, section.size);
+      } else {
+         Peripheral* peripheral = machine->getPeripheral (j - numberDevices);
+         name = peripheral->getName();
+         okay = peripheral->restoreState (state, section.size);
+      }
+
+      if (!okay) {
+         std::cerr << filename << ": invalid state for " << name << "\n";
+         status = false;
+      }
+   }
+
+   if (isChecked && !status) {
+      std::cerr << filename << ": snapshot only partly restored - "
+                   "the machine state is inconsistent\n";
+   }
+
+   munmap (map, fileSize);
+
+   // The active devices may have been restored before the memory and memory
+   // mapper, so only now discard any cached memory content.
+   //
+   if (isChecked) dataBus->allMemoryModified ();
+   return status;
+}
+
+// end
@@ -0,0 +1,68 @@
+/* snapshot.h
+ *
+ * Machine snapshot, part of the Locus 16 Emulator.
+ *
+ * SPDX-FileCopyrightText: 2022-2025  Andrew C. Starritt
+ * SPDX-License-Identifier: LGPL-3.0-only
+ *
+ * Contact details:
+ * andrew.starritt@gmail.com
+ */
+
+#ifndef L16E_SNAPSHOT_H
+#define L16E_SNAPSHOT_H
+
+#include <string>
+#include <stdint.h>
+
+namespace L16E {
+
+class Machine;
+
+// Saves and restores the state of a whole machine, i.e. of all devices and
+// peripherals, to/from a binary file. The machine must be configured as it
+// was when the snapshot was saved - the configuration itself is not saved.
+//
+// File layout (host byte order):
+//   Header
+//   Section [numberDevices + numberPeripherals]  - in data bus/crate order
+//   section data, each starting on a page boundary.
+//
+// Restoring is just a mmap of the file and a copy per section, the largest
+// being memory which is copied as is. All sections are checked against the
+// configuration before any is restored.
+//
+class Snapshot {
+public:
+   static bool save (const std::string filename, Machine* machine);
+   static bool restore (const std::string filename, Machine* machine);
+
+private:
+   enum Constants {
+      version = 1,
+      byteOrder = 0x01020304,
+      alignment = 4096,
+      nameSize = 40
+   };
+
+   struct Header {
+      char magic [8];            // "L16SNAP"
+      uint32_t version;
+      uint32_t byteOrder;
+      uint32_t numberDevices;
+      uint32_t numberPeripherals;
+   };
+
+   struct Section {
+      char name [nameSize];      // device/peripheral name, as a check
+      uint64_t offset;           // from the start of the file
+      uint64_t size;
+   };
+
+   explicit Snapshot ();
+   ~Snapshot ();
+};
+
+}
+
+#endif // L16E_SNAPSHOT_H
@@ -16,6 +16,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <stdint.h>
 
 using namespace L16E;
 
@@ -95,4 +96,43 @@ bool TapePunch::writeByte (const UInt8 value)
    return result;
 }
 
+//------------------------------------------------------------------------------
+//
+void TapePunch::saveState (std::vector<UInt8>& state) const
+{
+   const int64_t offset = (this->fd >= 0) ? lseek (this->fd, 0, SEEK_CUR) : 0;
+
+   const UInt8* p = reinterpret_cast <const UInt8*> (&offset);
+   state.assign (p, p + sizeof (offset));
+}
+
+//------------------------------------------------------------------------------
+// Anything punched since the snapshot is discarded. If the output file is
+// not the one in use when the snapshot was saved, e.g. a new file, then we
+// can only carry on from the end of the file.
+//
+bool TapePunch::restoreState (const UInt8* state, const size_t size)
+{
+   int64_t offset;
+   if (size != sizeof (offset)) return false;
+   memcpy (&offset, state, sizeof (offset));
+
+   if (this->fd < 0) return true;   // nothing to restore
+
+   struct stat info;
+   if (fstat (this->fd, &info) < 0) {
+      this->perrorf ("TapePunch::restoreState (%s)", this->filename.c_str());
+      return false;
+   }
+
+   offset = MIN (offset, int64_t (info.st_size));
+   if ((ftruncate (this->fd, offset) < 0) ||
+       (lseek (this->fd, offset, SEEK_SET) < 0))
+   {
+      this->perrorf ("TapePunch::restoreState (%s)", this->filename.c_str());
+      return false;
+   }
+   return true;
+}
+
 // end
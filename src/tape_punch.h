@@ -40,6 +40,11 @@ public:
    bool initialise();
    bool writeByte (const UInt8 value);
 
+   // The state is the file offset.
+   //
+   void saveState (std::vector<UInt8>& state) const;
+   bool restoreState (const UInt8* state, const size_t size);
+
 private:
    std::string filename;
    int fd;
@@ -16,6 +16,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <stdint.h>
 
 using namespace L16E;
 
@@ -101,4 +102,50 @@ bool TapeReader::readByte(UInt8& value)
    return result;
 }
 
+//------------------------------------------------------------------------------
+//
+int TapeReader::getPollDescriptor() const
+{
+   return this->fd;
+}
+
+//------------------------------------------------------------------------------
+//
+void TapeReader::saveState (std::vector<UInt8>& state) const
+{
+   // -1 means the end of the tape has been reached.
+   //
+   const int64_t offset = (this->fd >= 0) ? lseek (this->fd, 0, SEEK_CUR) : -1;
+
+   const UInt8* p = reinterpret_cast <const UInt8*> (&offset);
+   state.assign (p, p + sizeof (offset));
+}
+
+//------------------------------------------------------------------------------
+//
+bool TapeReader::restoreState (const UInt8* state, const size_t size)
+{
+   int64_t offset;
+   if (size != sizeof (offset)) return false;
+   memcpy (&offset, state, sizeof (offset));
+
+   if (offset < 0) {
+      if (this->fd >= 0) {
+         close(this->fd);
+         this->fd = -1;
+      }
+      return true;
+   }
+
+   // The tape may have been read to the end since.
+   //
+   if ((this->fd < 0) && !this->initialise()) return false;
+
+   if (lseek (this->fd, offset, SEEK_SET) < 0) {
+      this->perrorf ("TapeReader::restoreState (%s)", this->filename.c_str());
+      return false;
+   }
+   return true;
+}
+
 // end
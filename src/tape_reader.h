@@ -39,6 +39,12 @@ public:
    void setFilename (const std::string filename);
    bool initialise();
    bool readByte(UInt8& value);
+   int getPollDescriptor() const;
+
+   // The state is the file offset.
+   //
+   void saveState (std::vector<UInt8>& state) const;
+   bool restoreState (const UInt8* state, const size_t size);
 
 private:
    std::string filename;
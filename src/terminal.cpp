@@ -14,6 +14,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <string.h>
 #include <unistd.h>
 #include <iostream>
@@ -36,6 +37,8 @@ Terminal::Terminal ():
    this->xt_fd = -1;
    this->ptname = "";
    this->xterm_pid = -1;
+   this->headless = false;
+   this->endOfInput = false;
 }
 
 //------------------------------------------------------------------------------
@@ -63,12 +66,27 @@ void Terminal::clear()
    this->xterm_pid = -1;
 }
 
+//------------------------------------------------------------------------------
+//
+void Terminal::setHeadless (const bool headlessIn)
+{
+   this->headless = headlessIn;
+}
+
 //------------------------------------------------------------------------------
 //
 bool Terminal::initialise()
 {
    static const char* clearScreen = "\033[2J";
 
+   // Nothing to open. The standard input is left blocking, as it may be
+   // shared, e.g. with the shell - readByte polls it instead.
+   //
+   if (this->headless) {
+      this->endOfInput = false;
+      return true;
+   }
+
    // From https://stackoverflow.com/questions/9996730/
    //      unix-c-open-new-terminal-and-redirect-output-to-it
    //
@@ -197,7 +215,25 @@ bool Terminal::readByte (UInt8& value)
 {
    bool result;
 
-   if (this->xt_fd >= 0) {
+   if (this->headless) {
+      if (this->endOfInput) return false;
+
+      struct pollfd pfd;
+      pfd.fd = STDIN_FILENO;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      if (poll (&pfd, 1, 0) <= 0) return false;
+
+      const ssize_t number = read (STDIN_FILENO, &value, 1);
+      if (number <= 0) {
+         // number = 0 implies end of input.
+         //
+         this->endOfInput = true;
+         if (number < 0) this->perrorf ("Terminal::readByte()");
+      }
+      result = (number == 1);
+
+   } else if (this->xt_fd >= 0) {
       ssize_t number;
       number = read (this->xt_fd, &value, 1);
       if (number == 0) {
@@ -229,7 +265,12 @@ bool Terminal::writeByte(const UInt8 value)
 {
    bool result;
 
-   if (this->xt_fd >= 0) {
+   if (this->headless) {
+      // Via stdio, so as to keep in order with the emulator's own output.
+      //
+      result = (putchar (value) != EOF);
+
+   } else if (this->xt_fd >= 0) {
       ssize_t number;
       number = write (this->xt_fd, &value, 1);
 
@@ -249,4 +290,12 @@ bool Terminal::writeByte(const UInt8 value)
    return result;
 }
 
+//------------------------------------------------------------------------------
+//
+int Terminal::getPollDescriptor() const
+{
+   if (this->headless) return this->endOfInput ? -1 : STDIN_FILENO;
+   return this->xt_fd;
+}
+
 // end
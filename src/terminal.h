@@ -36,12 +36,19 @@ public:
    explicit Terminal ();
    virtual ~Terminal();
 
+   // When headless, e.g. in batch mode, the terminal reads the standard
+   // input and writes the standard output instead of opening an xterm.
+   // Must be set before initialise.
+   //
+   void setHeadless (const bool headless);
+
    // Initialise the terminal device.
    //
    bool initialise();
 
    bool readByte(UInt8& value);
    bool writeByte(const UInt8 value);
+   int getPollDescriptor() const;
 
 private:
    void clear();
@@ -50,6 +57,8 @@ private:
    int xt_fd;    // xterm device
    const char* ptname;
    int xterm_pid;
+   bool headless;
+   bool endOfInput;   // headless only
 };
 
 }
@@ -0,0 +1,87 @@
+/* trace_buffer.cpp
+ *
+ * Execution trace, part of the Locus 16 Emulator.
+ *
+ * SPDX-FileCopyrightText: 2022-2025  Andrew C. Starritt
+ * SPDX-License-Identifier: LGPL-3.0-only
+ *
+ * Contact details:
+ * andrew.starritt@gmail.com
+ */
+
+#include "trace_buffer.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+
+using namespace L16E;
+
+//------------------------------------------------------------------------------
+//
+TraceBuffer::TraceBuffer (const std::string filenameIn, const int capacityIn) :
+   filename (filenameIn),
+   map (nullptr),
+   mapSize (0),
+   header (nullptr),
+   records (nullptr),
+   mask (0)
+{
+   uint32_t capacity = 1;
+   while ((capacity < uint32_t (capacityIn)) && (capacity < 0x80000000)) capacity <<= 1;
+
+   const int fd = open (this->filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+   if (fd < 0) {
+      perror (this->filename.c_str());
+      return;
+   }
+
+   const size_t size = sizeof (Header) + size_t (capacity) * sizeof (Record);
+   if (ftruncate (fd, size) != 0) {
+      perror (this->filename.c_str());
+      close (fd);
+      return;
+   }
+
+   void* result = mmap (nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   close (fd);
+   if (result == MAP_FAILED) {
+      perror (this->filename.c_str());
+      return;
+   }
+
+   this->map = result;
+   this->mapSize = size;
+   this->header = static_cast <Header*> (result);
+   this->records = reinterpret_cast <Record*> (this->header + 1);
+   this->mask = capacity - 1;
+
+   memset (this->header, 0, sizeof (Header));
+   strncpy (this->header->magic, "L16TRCE", sizeof (this->header->magic));
+   this->header->version = version;
+   this->header->byteOrder = byteOrder;
+   this->header->recordSize = sizeof (Record);
+   this->header->capacity = capacity;
+   this->header->written = 0;
+}
+
+//------------------------------------------------------------------------------
+//
+TraceBuffer::~TraceBuffer ()
+{
+   if (this->map) {
+      munmap (this->map, this->mapSize);
+   }
+}
+
+//------------------------------------------------------------------------------
+//
+bool TraceBuffer::isOpen () const
+{
+   return this->map != nullptr;
+}
+
+// end
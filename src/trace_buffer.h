@@ -0,0 +1,88 @@
+/* trace_buffer.h
+ *
+ * Execution trace, part of the Locus 16 Emulator.
+ *
+ * SPDX-FileCopyrightText: 2022-2025  Andrew C. Starritt
+ * SPDX-License-Identifier: LGPL-3.0-only
+ *
+ * Contact details:
+ * andrew.starritt@gmail.com
+ */
+
+#ifndef L16E_TRACE_BUFFER_H
+#define L16E_TRACE_BUFFER_H
+
+#include <string>
+#include <stdint.h>
+#include "locus16_common.h"
+
+namespace L16E {
+
+// Records executed instructions into a ring buffer, being a file mapped
+// into memory, so recording is just a store of a fixed size binary record,
+// and the file holds the most recent records even if the emulator crashes.
+// The file is decoded offline, e.g. by locus16_trace.
+//
+// File layout (host byte order):
+//   Header
+//   Record [capacity]  - record n is at index n % capacity
+//
+class TraceBuffer {
+public:
+   enum Constants {
+      version = 1,
+      byteOrder = 0x01020304
+   };
+
+   enum Flags {
+      hasOperand = 0x01          // operand is valid
+   };
+
+   struct Header {
+      char magic [8];            // "L16TRCE"
+      uint32_t version;
+      uint32_t byteOrder;
+      uint32_t recordSize;
+      uint32_t capacity;         // records, a power of 2
+      uint64_t written;          // total number of records written
+   };
+
+   struct Record {
+      Int16 p;                   // instruction address
+      Int16 instruction;
+      Int16 a;                   // registers after execution
+      Int16 r;
+      Int16 s;
+      Int16 t;
+      Int16 operand;             // effective address of any memory operand
+      UInt8 level;               // at which executed
+      UInt8 flags;
+   };
+
+   // The capacity is rounded up to a power of 2.
+   //
+   explicit TraceBuffer (const std::string filename, const int capacity);
+   ~TraceBuffer ();
+
+   bool isOpen () const;
+
+   // Returns the record to be filled in next. Hot path - no checks.
+   //
+   Record* next ()
+   {
+      const uint64_t n = this->header->written++;
+      return &this->records [n & this->mask];
+   }
+
+private:
+   std::string filename;
+   void* map;
+   size_t mapSize;
+   Header* header;
+   Record* records;
+   uint64_t mask;
+};
+
+}
+
+#endif // L16E_TRACE_BUFFER_H
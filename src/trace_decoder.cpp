@@ -0,0 +1,131 @@
+/* trace_decoder.cpp
+ *
+ * Execution trace decoder, part of the Locus 16 Emulator.
+ *
+ * SPDX-FileCopyrightText: 2022-2025  Andrew C. Starritt
+ * SPDX-License-Identifier: LGPL-3.0-only
+ *
+ * Contact details:
+ * andrew.starritt@gmail.com
+ */
+
+// Lists the records of a trace file, as written by the emulator's TR command
+// or --trace option, as text, oldest first, e.g.
+//
+//   sequence  level  (address) instruction  disassembly  registers  operand
+//
+// usage: locus16_trace FILE [number]   - optionally the last number records
+//
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "locus16_common.h"
+#include "diagnostics.h"
+#include "trace_buffer.h"
+
+using namespace L16E;
+
+//------------------------------------------------------------------------------
+//
+int main (int argc, char** argv)
+{
+   if ((argc < 2) || (argc > 3)) {
+      fprintf (stderr, "usage: %s FILE [number]\n", argv [0]);
+      return 1;
+   }
+
+   const char* filename = argv [1];
+   long number = -1;   // all
+   if ((argc == 3) && ((sscanf (argv [2], "%ld", &number) != 1) || (number < 0))) {
+      fprintf (stderr, "invalid number: %s\n", argv [2]);
+      return 1;
+   }
+
+   const int fd = open (filename, O_RDONLY);
+   if (fd < 0) {
+      perror (filename);
+      return 1;
+   }
+
+   struct stat info;
+   if (fstat (fd, &info) != 0) {
+      perror (filename);
+      close (fd);
+      return 1;
+   }
+
+   const size_t fileSize = info.st_size;
+   if (fileSize < sizeof (TraceBuffer::Header)) {
+      fprintf (stderr, "%s: not a trace file\n", filename);
+      close (fd);
+      return 1;
+   }
+
+   void* map = mmap (nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+   close (fd);
+   if (map == MAP_FAILED) {
+      perror (filename);
+      return 1;
+   }
+
+   const TraceBuffer::Header* header = static_cast <const TraceBuffer::Header*> (map);
+   const TraceBuffer::Record* records = reinterpret_cast <const TraceBuffer::Record*> (header + 1);
+
+   if ((strncmp (header->magic, "L16TRCE", sizeof (header->magic)) != 0) ||
+       (header->version != TraceBuffer::version) ||
+       (header->byteOrder != TraceBuffer::byteOrder) ||
+       (header->recordSize != sizeof (TraceBuffer::Record)) ||
+       (header->capacity == 0) ||
+       (fileSize < sizeof (TraceBuffer::Header) + size_t (header->capacity) * sizeof (TraceBuffer::Record)))
+   {
+      fprintf (stderr, "%s: not a trace file, or from an incompatible version\n", filename);
+      munmap (map, fileSize);
+      return 1;
+   }
+
+   // The ring buffer holds the last capacity records, at most.
+   //
+   const uint64_t written = header->written;
+   uint64_t first = (written > header->capacity) ? written - header->capacity : 0;
+   if ((number >= 0) && (written - first > uint64_t (number))) first = written - number;
+
+   printf ("%lu records written, listing %lu\n",
+           (unsigned long) written, (unsigned long) (written - first));
+
+   const TraceBuffer::Record* previous = nullptr;
+   for (uint64_t n = first; n < written; n++) {
+      const TraceBuffer::Record* record = &records [n % header->capacity];
+
+      // The previous instruction only helps name a conditional jump if it was
+      // the instruction before this one in memory.
+      //
+      const Int16 prev = (previous && (previous->p == Int16 (record->p - 2))) ? previous->instruction : 0;
+
+      char text [20];
+      Diagnostics::disassemble (record->instruction, prev, text, sizeof (text));
+
+      char operand [12] = "";
+      if (record->flags & TraceBuffer::hasOperand) {
+         snprintf (operand, sizeof (operand), "[%04X]", record->operand & 0xFFFF);
+      }
+
+      printf ("%10lu L%d (%04X) %04X  %-16s A:%04X R:%04X S:%04X T:%04X %s\n",
+              (unsigned long) n, record->level, record->p & 0xFFFF,
+              record->instruction & 0xFFFF, text,
+              record->a & 0xFFFF, record->r & 0xFFFF, record->s & 0xFFFF,
+              record->t & 0xFFFF, operand);
+
+      previous = record;
+   }
+
+   munmap (map, fileSize);
+   return 0;
+}
+
+// end